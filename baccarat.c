@@ -0,0 +1,348 @@
+/*
+ * baccarat.c - Punto banco dealing and exact composition pricing.
+ */
+#include <errno.h>
+#include "baccarat.h"
+
+#define BACCARAT_VALUES 10 // Card values 0 (tens and faces) to 9
+
+/*
+ * struct coup_odds - Probabilities accumulated by the exact enumeration.
+ * @player: Player wins.
+ * @banker: Banker wins.
+ * @tie: Ties.
+ * @dragon: Banker wins with a three card 7.
+ * @panda: Player wins with a three card 8.
+ */
+struct coup_odds {
+	double player;
+	double banker;
+	double tie;
+	double dragon;
+	double panda;
+};
+
+/*
+ * baccarat_value - Baccarat value of a rank.
+ * @rank: Rank of the card.
+ *
+ * Return: Pip value for ace to nine, 0 for tens and faces, or -1 for an
+ * invalid rank.
+ */
+int baccarat_value(Rank rank)
+{
+	if (rank < ACE || rank > KING)
+		return -1;
+	return rank >= TEN ? 0 : (int)rank;
+}
+
+/*
+ * banker_draws - Apply the banker's third card rule.
+ * @banker: Banker's two card total.
+ * @third: Value of the player's third card, or -1 if the player stood.
+ *
+ * Return: 1 if the banker draws, otherwise 0.
+ */
+static _Bool banker_draws(int banker, int third)
+{
+	if (third < 0)
+		return banker <= 5;
+	switch (banker) {
+	case 0:
+	case 1:
+	case 2:
+		return 1;
+	case 3:
+		return third != 8;
+	case 4:
+		return third >= 2 && third <= 7;
+	case 5:
+		return third >= 4 && third <= 7;
+	case 6:
+		return third == 6 || third == 7;
+	default:
+		return 0;
+	}
+}
+
+/*
+ * baccarat_coup - Deal a coup of baccarat from a deck.
+ * @deck: Deck to deal from.
+ * @coup: Where to store the result.
+ *
+ * Cards go player, banker, player, banker, then a third card to each hand as
+ * the tableau requires. A natural 8 or 9 in either hand ends the coup.
+ *
+ * Return: 0 on success, -1 on error with errno set to EINVAL or ENODATA if
+ * the deck ran out mid-coup.
+ */
+int baccarat_coup(Deck *deck, BaccaratCoup *coup)
+{
+	if (deck == NULL || coup == NULL) {
+		errno = EINVAL;
+		return -1;
+	}
+	Suit suit;
+	coup->num_dealt = 0;
+	for (int i = 0; i < 4; i++) {
+		if (deck_draw(deck, &coup->dealt[coup->num_dealt++], &suit) < 0)
+			return -1;
+	}
+	const Rank *ranks = coup->dealt;
+	int player = (baccarat_value(ranks[0]) + baccarat_value(ranks[2])) % 10;
+	int banker = (baccarat_value(ranks[1]) + baccarat_value(ranks[3])) % 10;
+	coup->player_pair = ranks[0] == ranks[2];
+	coup->banker_pair = ranks[1] == ranks[3];
+	coup->player_cards = 2;
+	coup->banker_cards = 2;
+	if (player < 8 && banker < 8) {
+		int third = -1;
+		if (player <= 5) {
+			Rank *rank = &coup->dealt[coup->num_dealt++];
+			if (deck_draw(deck, rank, &suit) < 0)
+				return -1;
+			third = baccarat_value(*rank);
+			player = (player + third) % 10;
+			coup->player_cards = 3;
+		}
+		if (banker_draws(banker, third)) {
+			Rank *rank = &coup->dealt[coup->num_dealt++];
+			if (deck_draw(deck, rank, &suit) < 0)
+				return -1;
+			banker = (banker + baccarat_value(*rank)) % 10;
+			coup->banker_cards = 3;
+		}
+	}
+	coup->player_total = player;
+	coup->banker_total = banker;
+	coup->outcome = player > banker ? BACCARAT_PLAYER :
+			player < banker ? BACCARAT_BANKER : BACCARAT_TIE;
+	return 0;
+}
+
+/*
+ * settle - Add a finished coup to the odds.
+ * @odds: Odds to add to.
+ * @player: Player's final total.
+ * @banker: Banker's final total.
+ * @player_cards: Cards in the player's hand.
+ * @banker_cards: Cards in the banker's hand.
+ * @weight: Probability of the coup.
+ */
+static void settle(struct coup_odds *odds, int player, int banker,
+		   int player_cards, int banker_cards, double weight)
+{
+	if (player > banker) {
+		odds->player += weight;
+		if (player == 8 && player_cards == 3)
+			odds->panda += weight;
+	} else if (banker > player) {
+		odds->banker += weight;
+		if (banker == 7 && banker_cards == 3)
+			odds->dragon += weight;
+	} else {
+		odds->tie += weight;
+	}
+}
+
+/*
+ * banker_third - Finish a coup after the player's hand is complete.
+ * @odds: Odds to add to.
+ * @values: Cards left of each value.
+ * @left: Total cards left.
+ * @player: Player's final total.
+ * @player_cards: Cards in the player's hand.
+ * @banker: Banker's two card total.
+ * @third: Value of the player's third card, or -1 if the player stood.
+ * @weight: Probability of reaching this point.
+ */
+static void banker_third(struct coup_odds *odds, const unsigned *values,
+			 unsigned left, int player, int player_cards,
+			 int banker, int third, double weight)
+{
+	if (!banker_draws(banker, third)) {
+		settle(odds, player, banker, player_cards, 2, weight);
+		return;
+	}
+	for (int v = 0; v < BACCARAT_VALUES; v++) {
+		if (values[v] == 0)
+			continue;
+		settle(odds, player, (banker + v) % 10, player_cards, 3,
+		       weight * values[v] / left);
+	}
+}
+
+/*
+ * draw_pair - Weight of drawing two cards of given values, in either order.
+ * @values: Cards left of each value, both cards are removed.
+ * @left: Total cards left before the draw.
+ * @first: Value of one card.
+ * @second: Value of the other card, not below @first.
+ *
+ * Return: Probability of the pair, 0 if it cannot be drawn, in which case
+ * nothing is removed.
+ */
+static double draw_pair(unsigned *values, unsigned left, int first, int second)
+{
+	if (values[first] == 0)
+		return 0.0;
+	double weight = (double)values[first]-- / left;
+	if (values[second] == 0) {
+		values[first]++;
+		return 0.0;
+	}
+	weight *= (double)values[second]-- / (left - 1);
+	return first == second ? weight : 2.0 * weight;
+}
+
+/*
+ * enumerate - Enumerate every coup the shoe can deal.
+ * @odds: Odds to fill.
+ * @values: Cards left of each value, restored before returning.
+ * @left: Total cards left, at least BACCARAT_MIN_CARDS.
+ *
+ * Draws without replacement are exchangeable, so the player's and banker's
+ * first two cards are taken as unordered pairs, 55 of each, before third
+ * cards follow the tableau. At most about 300,000 paths, and far fewer with
+ * naturals and stands.
+ */
+static void enumerate(struct coup_odds *odds, unsigned *values, unsigned left)
+{
+	unsigned rest = left - 4;
+	for (int p1 = 0; p1 < BACCARAT_VALUES; p1++) {
+		for (int p2 = p1; p2 < BACCARAT_VALUES; p2++) {
+			double wp = draw_pair(values, left, p1, p2);
+			if (wp == 0.0)
+				continue;
+			int player = (p1 + p2) % 10;
+			for (int b1 = 0; b1 < BACCARAT_VALUES; b1++) {
+				for (int b2 = b1; b2 < BACCARAT_VALUES; b2++) {
+					double weight = wp * draw_pair(values,
+						left - 2, b1, b2);
+					if (weight == 0.0)
+						continue;
+					int banker = (b1 + b2) % 10;
+					if (player >= 8 || banker >= 8) {
+						settle(odds, player, banker, 2, 2,
+						       weight);
+					} else if (player >= 6) {
+						banker_third(odds, values, rest, player,
+							     2, banker, -1, weight);
+					} else {
+						for (int p3 = 0; p3 < BACCARAT_VALUES;
+						     p3++) {
+							if (values[p3] == 0)
+								continue;
+							double w = weight * values[p3]-- /
+								   rest;
+							banker_third(odds, values,
+								     rest - 1,
+								     (player + p3) % 10,
+								     3, banker, p3, w);
+							values[p3]++;
+						}
+					}
+					values[b1]++;
+					values[b2]++;
+				}
+			}
+			values[p1]++;
+			values[p2]++;
+		}
+	}
+}
+
+/*
+ * baccarat_ev - Price every bet on the next coup from the shoe's composition.
+ * @counts: Cards left of each rank, ace first, BACCARAT_RANKS entries.
+ * @ev: Where to store the prices.
+ *
+ * Every way the next coup can be dealt without replacement is enumerated
+ * exactly, so the prices are those of the shoe as it stands, not of a fresh
+ * one. Pair bets only need the chance that two cards share a rank, which is
+ * closed form. A full shoe prices in well under a millisecond, so this can
+ * run after every coup.
+ *
+ * Return: 0 on success, -1 on error with errno set to EINVAL, or ENODATA if
+ * fewer than BACCARAT_MIN_CARDS cards are left.
+ */
+int baccarat_ev(const unsigned *counts, BaccaratEv *ev)
+{
+	if (counts == NULL || ev == NULL) {
+		errno = EINVAL;
+		return -1;
+	}
+	unsigned values[BACCARAT_VALUES] = { 0 };
+	unsigned left = 0;
+	double pairs = 0.0;
+	for (int rank = 0; rank < BACCARAT_RANKS; rank++) {
+		values[baccarat_value((Rank)(rank + ACE))] += counts[rank];
+		left += counts[rank];
+		pairs += (double)counts[rank] * (counts[rank] > 0 ?
+						 counts[rank] - 1 : 0);
+	}
+	if (left < BACCARAT_MIN_CARDS) {
+		errno = ENODATA;
+		return -1;
+	}
+	struct coup_odds odds = { 0 };
+	enumerate(&odds, values, left);
+	double pair = pairs / ((double)left * (left - 1));
+
+	ev->player = odds.player;
+	ev->banker = odds.banker;
+	ev->tie = odds.tie;
+	ev->ev[BET_PLAYER] = odds.player - odds.banker;
+	ev->ev[BET_BANKER] = 0.95 * odds.banker - odds.player;
+	ev->ev[BET_TIE] = 8.0 * odds.tie - (1.0 - odds.tie);
+	ev->ev[BET_PLAYER_PAIR] = 11.0 * pair - (1.0 - pair);
+	ev->ev[BET_BANKER_PAIR] = ev->ev[BET_PLAYER_PAIR];
+	ev->ev[BET_DRAGON_7] = 40.0 * odds.dragon - (1.0 - odds.dragon);
+	ev->ev[BET_PANDA_8] = 25.0 * odds.panda - (1.0 - odds.panda);
+	return 0;
+}
+
+/*
+ * baccarat_scan - Price every coup of a shoe and tally the edges found.
+ * @deck: Shuffled shoe to play through.
+ * @cut: Cards left at which the shoe ends, at least BACCARAT_MIN_CARDS.
+ * @scan: Tallies to add the shoe to.
+ *
+ * Before each coup the composition left is priced with baccarat_ev(), and
+ * every bet with a positive expectation is tallied, so many shoes can be
+ * scanned into one result to measure how exploitable each bet is to a
+ * perfect counter.
+ *
+ * Return: 0 on success, -1 on error with errno set.
+ */
+int baccarat_scan(Deck *deck, size_t cut, BaccaratScan *scan)
+{
+	if (deck == NULL || scan == NULL || cut < BACCARAT_MIN_CARDS) {
+		errno = EINVAL;
+		return -1;
+	}
+	unsigned cards[STANDARD_DECK_SIZE];
+	if (deck_composition(deck, cards) < 0)
+		return -1;
+	unsigned counts[BACCARAT_RANKS] = { 0 };
+	for (int i = 0; i < STANDARD_DECK_SIZE; i++)
+		counts[i % 13] += cards[i];
+	while (deck_size(deck) > cut) {
+		BaccaratEv ev;
+		if (baccarat_ev(counts, &ev) < 0)
+			return -1;
+		for (int bet = 0; bet < BACCARAT_BETS; bet++) {
+			if (ev.ev[bet] > 0) {
+				scan->positive[bet]++;
+				scan->gain[bet] += ev.ev[bet];
+			}
+		}
+		BaccaratCoup coup;
+		if (baccarat_coup(deck, &coup) < 0)
+			return -1;
+		scan->coups++;
+		for (int i = 0; i < coup.num_dealt; i++)
+			counts[coup.dealt[i] - ACE]--;
+	}
+	return 0;
+}
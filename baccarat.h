@@ -0,0 +1,86 @@
+#ifndef BACCARAT_H
+#define BACCARAT_H
+
+#include <stdint.h> // provides uint64_t
+#include "cards.h"
+
+#define BACCARAT_RANKS 13 // Ace to king, for pair bets
+#define BACCARAT_MIN_CARDS 6 // Most cards a coup can use
+
+/* Which hand a coup went to. */
+typedef enum baccarat_outcome {
+	BACCARAT_PLAYER,
+	BACCARAT_BANKER,
+	BACCARAT_TIE
+} BaccaratOutcome;
+
+/* The wagers priced by baccarat_ev(). */
+typedef enum baccarat_bet {
+	BET_PLAYER, /* Pays 1 to 1, pushes on a tie */
+	BET_BANKER, /* Pays 0.95 to 1, pushes on a tie */
+	BET_TIE, /* Pays 8 to 1 */
+	BET_PLAYER_PAIR, /* Player's first two cards pair, pays 11 to 1 */
+	BET_BANKER_PAIR, /* Banker's first two cards pair, pays 11 to 1 */
+	BET_DRAGON_7, /* Banker wins with a three card 7, pays 40 to 1 */
+	BET_PANDA_8, /* Player wins with a three card 8, pays 25 to 1 */
+	BACCARAT_BETS
+} BaccaratBet;
+
+/*
+ * struct baccarat_coup - Result of one coup of baccarat.
+ * @player_total: Final total of the player's hand, 0 to 9.
+ * @banker_total: Final total of the banker's hand, 0 to 9.
+ * @player_cards: Number of cards the player's hand took, 2 or 3.
+ * @banker_cards: Number of cards the banker's hand took, 2 or 3.
+ * @player_pair: If the player's first two cards share a rank.
+ * @banker_pair: If the banker's first two cards share a rank.
+ * @outcome: Which hand won.
+ * @num_dealt: Number of cards the coup dealt, 4 to 6.
+ * @dealt: Ranks of the cards in the order they were dealt.
+ */
+typedef struct baccarat_coup {
+	int player_total;
+	int banker_total;
+	int player_cards;
+	int banker_cards;
+	_Bool player_pair;
+	_Bool banker_pair;
+	BaccaratOutcome outcome;
+	int num_dealt;
+	Rank dealt[BACCARAT_MIN_CARDS];
+} BaccaratCoup;
+
+/*
+ * struct baccarat_ev - Exact prices of every bet on the next coup.
+ * @player: Probability the player's hand wins.
+ * @banker: Probability the banker's hand wins.
+ * @tie: Probability of a tie.
+ * @ev: Expected return per unit staked on each BaccaratBet.
+ */
+typedef struct baccarat_ev {
+	double player;
+	double banker;
+	double tie;
+	double ev[BACCARAT_BETS];
+} BaccaratEv;
+
+/*
+ * struct baccarat_scan - Bets with an edge over the coups of shoes.
+ * @coups: Coups played.
+ * @positive: Coups where each bet had a positive expectation.
+ * @gain: Summed expectation of each bet over the coups where it was
+ *        positive, the return of a player betting only then.
+ */
+typedef struct baccarat_scan {
+	uint64_t coups;
+	uint64_t positive[BACCARAT_BETS];
+	double gain[BACCARAT_BETS];
+} BaccaratScan;
+
+/* Function prototypes. */
+int baccarat_value(Rank rank);
+int baccarat_coup(Deck *deck, BaccaratCoup *coup);
+int baccarat_ev(const unsigned *counts, BaccaratEv *ev);
+int baccarat_scan(Deck *deck, size_t cut, BaccaratScan *scan);
+
+#endif // BACCARAT_H
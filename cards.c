@@ -2,11 +2,21 @@
  * cards.c - Implementation of cards and decks.
  */
 #include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <unistd.h>
+#ifdef __BMI2__
+#include <immintrin.h>
+#endif
 #include "cards.h"
+#include "cardset.h"
 
 /*
  * struct card - Represents a playing card.
@@ -20,14 +30,84 @@ struct card {
 
 /*
  * struct deck - Represents a deck of playing cards.
- * @cards: Pointer to the dynamically allocated array of cards in the deck.
- * @head: Index of the top card in the deck (next card to be dealt).
- * @tail: Index of the bottom card in the deck (final card in the deck).
+ * @cards: Pointer to the dynamically allocated ring of cards in the deck.
+ * @burned: Flags the cards of @cards that were burned, unseen by the count.
+ * @capacity: Number of cards in the ring.
+ * @discard: Position of the oldest card in the discard tray.
+ * @played: Position one past the newest card in the discard tray, where the
+ *          cards still in play start.
+ * @head: Position of the top card in the deck (next card to be dealt).
+ * @tail: Position of the bottom card in the deck (final card in the deck).
+ * @packs: Number of standard packs the deck was generated from.
+ * @seed: Seed the shuffle generator was last seeded with.
+ * @stream: Stream id the shuffle generator was last seeded with.
+ * @rng: Generator used to shuffle the deck.
+ * @shuffles: Times deck_shuffle() has run since the generator was seeded.
+ * @counted: Cards from the first one dealt that @running covers.
+ * @running: Hi-Lo running count of the first @counted cards dealt.
+ * @csm: Shelves of the continuous shuffler the deck is loaded in, or NULL
+ *       for a deck dealt from head to tail. See deck_csm().
+ *
+ * Positions count along the ring, card p sitting at @cards[p % @capacity],
+ * and are kept below 2 * @capacity so no division is needed to find it. In
+ * ring order the discard tray runs from @discard to @played, the cards in
+ * play from @played to @head and the deck from @head to @tail, which wraps
+ * round to @discard again. Dealing leaves a card where it was below @head,
+ * deck_discard() reorders the cards in play into the tray as they are picked
+ * up, and deck_reinsert() hands the oldest discards back under @tail, all in
+ * place. deck_count() catches @running up from @counted without touching
+ * the dealing path.
  */
 struct deck {
 	Card *cards;
+	_Bool *burned;
+	size_t capacity;
+	size_t discard;
+	size_t played;
 	size_t head;
 	size_t tail;
+	int packs;
+	uint64_t seed;
+	uint64_t stream;
+	Rng rng;
+	size_t shuffles;
+	size_t counted;
+	int running;
+	struct csm *csm;
+};
+
+#define CSM_NONE UINT32_MAX // No slot, ends a shelf or the free list
+
+/*
+ * struct csm - Shelves of a continuous shuffling machine.
+ * @shelves: Number of shelves.
+ * @capacity: Cards in the deck, whether dealt, in the tray or shelved.
+ * @shelved: Cards on the shelves.
+ * @num_live: Number of shelves holding cards.
+ * @free_slot: First unused slot.
+ * @top: Slot of the top card of each shelf, CSM_NONE if it is empty.
+ * @count: Cards on each shelf.
+ * @live: Shelves holding cards, in no order, for picking one in O(1).
+ * @where: Index of each shelf in @live.
+ * @slots: Card held by each slot.
+ * @next: Slot under each shelved slot, or the next unused slot.
+ *
+ * While a deck is in a machine its ring never wraps and only holds the
+ * dealt cards, below @head, and the tray, from @head to @tail. The rest sit
+ * on shelves as linked stacks of slots, so a card goes onto a shelf in O(1).
+ */
+struct csm {
+	uint32_t shelves;
+	uint32_t capacity;
+	uint32_t shelved;
+	uint32_t num_live;
+	uint32_t free_slot;
+	uint32_t *top;
+	uint32_t *count;
+	uint32_t *live;
+	uint32_t *where;
+	Card *slots;
+	uint32_t *next;
 };
 
 /*
@@ -40,6 +120,71 @@ struct hand {
 	Hand *next;
 };
 
+#define SNAPSHOT_MAGIC "CCSNAP"
+#define SNAPSHOT_VERSION 3
+
+#define TABLE_BYTE_ORDER 0x01020304 // Reads back differently if swapped
+
+/*
+ * struct table_header - Header of a precomputed table file.
+ * @magic: Caller's magic string, NUL padded.
+ * @version: Caller's format version.
+ * @byte_order: TABLE_BYTE_ORDER as the writer stored it.
+ * @size: Size of the payload following the header in bytes.
+ * @checksum: FNV-1a hash of the payload.
+ *
+ * The header is a multiple of 8 bytes, so a payload mapped behind it is
+ * aligned for any integer type.
+ */
+struct table_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t byte_order;
+	uint64_t size;
+	uint64_t checksum;
+};
+
+/*
+ * struct snapshot_header - Header of a binary shoe snapshot.
+ * @magic: SNAPSHOT_MAGIC, NUL padded.
+ * @version: SNAPSHOT_VERSION of the writer.
+ * @card_size: sizeof(Card) of the writer, guards against ABI mismatches.
+ * @num_cards: Number of cards stored for the deck.
+ * @discard: Position of the deck's oldest discard.
+ * @played: Position of the deck's first card in play.
+ * @head: Head position of the deck.
+ * @tail: Tail position of the deck.
+ * @packs: Packs recorded for the deck.
+ * @seed: Seed recorded for the deck.
+ * @stream: Stream id recorded for the deck.
+ * @rng: State of the deck's shuffle generator.
+ * @shuffles: Shuffles of the deck since its generator was seeded.
+ * @num_hands: Number of hands stored.
+ * @num_counts: Number of counters stored.
+ *
+ * Snapshots are native endian. The header is followed by @num_counts int64_t
+ * counters, @num_hands uint64_t hand lengths, the deck's ring of cards, the
+ * cards of each hand and then a byte per card of the ring flagging burns, so
+ * every section can be copied straight out of a mapping of the file.
+ */
+struct snapshot_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t card_size;
+	uint64_t num_cards;
+	uint64_t discard;
+	uint64_t played;
+	uint64_t head;
+	uint64_t tail;
+	int64_t packs;
+	uint64_t seed;
+	uint64_t stream;
+	Rng rng;
+	uint64_t shuffles;
+	uint64_t num_hands;
+	uint64_t num_counts;
+};
+
 /*
  * card_rep - Write a human-readable string for a playing card.
  * @buffer: Buffer to write the string representation.
@@ -112,202 +257,2102 @@ int card_rep(char *buffer, size_t buf_size, const Card *card)
 		errno = EINVAL;
 		return -1;
 	}
-	snprintf(buffer, CARD_STR_LEN, "%s%c", rank_str, suit_str);
-	return 0;
+	snprintf(buffer, CARD_STR_LEN, "%s%c", rank_str, suit_str);
+	return 0;
+}
+
+/*
+ * ring_index - Find a position of a deck in its ring.
+ * @deck: Pointer to the deck.
+ * @position: Position below 2 * @deck->capacity.
+ *
+ * Return: Index of @deck->cards holding the card at @position.
+ */
+static size_t ring_index(const Deck *deck, size_t position)
+{
+	return position < deck->capacity ? position :
+					   position - deck->capacity;
+}
+
+/*
+ * deck_rep - Write a human-readable string for a deck of cards.
+ * @deck: Deck to print.
+ *
+ * Displays cards in deck with up to 26 cards per line.
+ *
+ * Return: 0 on success, -1 on error with errno set.
+ */
+int deck_rep(Deck *deck)
+{
+	if (deck == NULL) {
+		errno = EINVAL;
+		return -1;
+	}
+	char buffer[CARD_STR_LEN];
+	size_t buf_size = sizeof(buffer);
+	size_t index = deck->head;
+	size_t length = 0;
+	while (index <= deck->tail) {
+		const Card *card = &deck->cards[ring_index(deck, index)];
+		card_rep(buffer, buf_size, card);
+		if (length >= DECK_REP_LEN) {
+			if (printf("\n") < 0) {
+				errno = EIO;
+				return -1;
+			}
+			length = 0;
+		}
+		if (printf("%s ", buffer) < 0) {
+			errno = EIO;
+			return -1;
+		}
+		index++;
+		length++;
+	}
+	printf("\n");
+	return 0;
+}
+
+/*
+ * hand_rep - Write a human-readable string for a hand of cards.
+ * @deck: Hand to print.
+ *
+ * Displays cards in a hand, with up to 7 cards per line.
+ *
+ * Return: 0 on success, -1 on error with errno set.
+ */
+int hand_rep(Hand *hand)
+{
+	if (hand == NULL) {
+		errno = EINVAL;
+		return -1;
+	}
+	char buffer[CARD_STR_LEN];
+	size_t buf_size = sizeof(buffer);
+	size_t length = 0;
+	for (Hand *ptr = hand; ptr != NULL; ptr = ptr->next) {
+		card_rep(buffer, buf_size, &ptr->card);
+		if (length >= HAND_REP_LEN) {
+			if (printf("\n") < 0) {
+				errno = EIO;
+				return -1;
+			}
+			length = 0;
+		}
+		if (printf("%s ", buffer) < 0) {
+			errno = EIO;
+			return -1;
+		}
+		length++;
+	}
+	printf("\n");
+	return 0;
+}
+
+/*
+ * rng_seed - Seed a random number generator.
+ * @rng: Generator to seed.
+ * @seed: Starting state of the generator.
+ * @stream: Stream id, generators on different streams are independent.
+ */
+void rng_seed(Rng *rng, uint64_t seed, uint64_t stream)
+{
+	rng->state = 0;
+	rng->inc = (stream << 1) | 1;
+	rng_next(rng);
+	rng->state += seed;
+	rng_next(rng);
+}
+
+/*
+ * rng_next - Generate the next random number.
+ * @rng: Generator to advance.
+ *
+ * Return: Uniformly distributed 32-bit value.
+ */
+uint32_t rng_next(Rng *rng)
+{
+	uint64_t old = rng->state;
+	rng->state = old * 6364136223846793005ULL + rng->inc;
+	uint32_t xorshifted = (uint32_t)(((old >> 18) ^ old) >> 27);
+	uint32_t rot = (uint32_t)(old >> 59);
+	return (xorshifted >> rot) | (xorshifted << ((-rot) & 31));
+}
+
+/*
+ * rng_bounded - Generate a random number below a bound without modulo bias.
+ * @rng: Generator to advance.
+ * @bound: Exclusive upper bound, must be greater than 0.
+ *
+ * Return: Uniformly distributed value in [0, @bound).
+ */
+uint32_t rng_bounded(Rng *rng, uint32_t bound)
+{
+	uint32_t threshold = -bound % bound;
+	for (;;) {
+		uint32_t value = rng_next(rng);
+		if (value >= threshold)
+			return value % bound;
+	}
+}
+
+/*
+ * draw_below - Draw a number below a bound for a shuffle model.
+ * @rng: Generator to draw from.
+ * @bound: Exclusive upper bound, greater than 0.
+ *
+ * A multiply and shift, without rng_bounded()'s divisions. The bias is
+ * below @bound / 2^32, far under what any model of a hand shuffle resolves.
+ *
+ * Return: Value in [0, @bound).
+ */
+static size_t draw_below(Rng *rng, uint32_t bound)
+{
+	return (size_t)(((uint64_t)rng_next(rng) * bound) >> 32);
+}
+
+/*
+ * random_seed - Pick a shuffle seed for a deck that was not given one.
+ *
+ * rand() is not thread-safe, so this is only used for decks created without
+ * a seed.
+ *
+ * Return: Seed built from two calls to rand().
+ */
+static uint64_t random_seed(void)
+{
+	return ((uint64_t)rand() << 32) ^ (uint64_t)rand();
+}
+
+/*
+ * deck_alloc - Allocate an unfilled deck.
+ * @num_cards: Number of cards the deck holds, must be greater than 0.
+ * @packs: Number of packs to record for the deck, 0 if not generated.
+ * @seed: Seed of the shuffle generator.
+ * @stream: Stream id of the shuffle generator.
+ *
+ * Return: Pointer to the new deck, or NULL on error with errno set.
+ */
+static Deck *deck_alloc(size_t num_cards, int packs, uint64_t seed,
+			uint64_t stream)
+{
+	struct card *cards = malloc(num_cards * sizeof(struct card));
+	_Bool *burned = calloc(num_cards, sizeof(*burned));
+	Deck *deck = malloc(sizeof(Deck));
+	if (cards == NULL || burned == NULL || deck == NULL) {
+		free(cards);
+		free(burned);
+		free(deck);
+		errno = ENOMEM;
+		return NULL;
+	}
+	deck->cards = cards;
+	deck->burned = burned;
+	deck->capacity = num_cards;
+	deck->discard = 0;
+	deck->played = 0;
+	deck->head = 0;
+	deck->tail = num_cards - 1;
+	deck->packs = packs;
+	deck->counted = 0;
+	deck->running = 0;
+	deck->csm = NULL;
+	deck_seed(deck, seed, stream);
+	return deck;
+}
+
+/*
+ * tray_size - Cards left in a deck's array.
+ * @deck: Pointer to the deck.
+ *
+ * Return: Cards from @head to @tail, which for a deck in a continuous
+ * shuffler leaves out the shelves.
+ */
+static size_t tray_size(const Deck *deck)
+{
+	return deck->head > deck->tail ? 0 : deck->tail - deck->head + 1;
+}
+
+/*
+ * ring_reverse - Reverse part of a deck's ring in place.
+ * @deck: Pointer to the deck.
+ * @from: First index of @deck->cards to reverse.
+ * @to: Index one past the last to reverse.
+ */
+static void ring_reverse(Deck *deck, size_t from, size_t to)
+{
+	for (; from + 1 < to; from++, to--) {
+		Card card = deck->cards[from];
+		deck->cards[from] = deck->cards[to - 1];
+		deck->cards[to - 1] = card;
+		_Bool burned = deck->burned[from];
+		deck->burned[from] = deck->burned[to - 1];
+		deck->burned[to - 1] = burned;
+	}
+}
+
+/*
+ * ring_unwrap - Rotate a deck's ring so its positions start at 0.
+ * @deck: Pointer to the deck.
+ *
+ * Afterwards the deck runs straight from @head to @tail through the array,
+ * for the shuffles that work on it in one piece. A deck that has not had
+ * cards reinserted is already unwrapped and is left alone.
+ */
+static void ring_unwrap(Deck *deck)
+{
+	if (deck->tail < deck->capacity)
+		return;
+	size_t base = deck->discard, shift = ring_index(deck, base);
+	ring_reverse(deck, 0, shift);
+	ring_reverse(deck, shift, deck->capacity);
+	ring_reverse(deck, 0, deck->capacity);
+	deck->discard -= base;
+	deck->played -= base;
+	deck->head -= base;
+	deck->tail -= base;
+	deck->counted -= base;
+}
+
+/*
+ * hilo_tag - Hi-Lo count tag of a rank.
+ * @rank: Rank of the card.
+ *
+ * Return: +1 for two to six, -1 for tens, faces and aces, otherwise 0.
+ */
+static int hilo_tag(Rank rank)
+{
+	if (rank >= TWO && rank <= SIX)
+		return 1;
+	return (rank == ACE || rank >= TEN) ? -1 : 0;
+}
+
+/*
+ * count_up - Catch a deck's Hi-Lo count up with the cards dealt.
+ * @deck: Pointer to the deck.
+ *
+ * Burned cards are dealt unseen, so they are passed over.
+ */
+static void count_up(Deck *deck)
+{
+	for (; deck->counted < deck->head; deck->counted++) {
+		size_t index = ring_index(deck, deck->counted);
+		if (!deck->burned[index])
+			deck->running += hilo_tag(deck->cards[index].rank);
+	}
+}
+
+/*
+ * csm_free - Take a deck out of its continuous shuffler.
+ * @deck: Pointer to the deck, its shelves must already be empty or
+ *        abandoned.
+ */
+static void csm_free(Deck *deck)
+{
+	struct csm *csm = deck->csm;
+	if (csm == NULL)
+		return;
+	free(csm->top);
+	free(csm->count);
+	free(csm->live);
+	free(csm->where);
+	free(csm->slots);
+	free(csm->next);
+	free(csm);
+	deck->csm = NULL;
+}
+
+/*
+ * csm_shelve - Put a card on a random shelf of a continuous shuffler.
+ * @csm: Shelves of the machine, with a free slot.
+ * @rng: Generator to pick the shelf with.
+ * @card: Card to shelve.
+ */
+static void csm_shelve(struct csm *csm, Rng *rng, Card card)
+{
+	uint32_t slot = csm->free_slot;
+	uint32_t shelf = (uint32_t)draw_below(rng, csm->shelves);
+	csm->free_slot = csm->next[slot];
+	csm->slots[slot] = card;
+	csm->next[slot] = csm->top[shelf];
+	csm->top[shelf] = slot;
+	if (csm->count[shelf]++ == 0) {
+		csm->where[shelf] = csm->num_live;
+		csm->live[csm->num_live++] = shelf;
+	}
+	csm->shelved++;
+}
+
+/*
+ * csm_unload - Empty a shelf of a continuous shuffler into a deck's array.
+ * @deck: Pointer to the deck.
+ * @shelf: Shelf to empty, holding cards.
+ * @at: Index of the array to write the top card to.
+ *
+ * Return: Number of cards written.
+ */
+static size_t csm_unload(Deck *deck, uint32_t shelf, size_t at)
+{
+	struct csm *csm = deck->csm;
+	size_t written = 0;
+	for (uint32_t slot = csm->top[shelf]; slot != CSM_NONE;) {
+		uint32_t below = csm->next[slot];
+		deck->cards[at + written++] = csm->slots[slot];
+		csm->next[slot] = csm->free_slot;
+		csm->free_slot = slot;
+		slot = below;
+	}
+	csm->top[shelf] = CSM_NONE;
+	csm->count[shelf] = 0;
+	uint32_t moved = csm->live[--csm->num_live];
+	csm->live[csm->where[shelf]] = moved;
+	csm->where[moved] = csm->where[shelf];
+	csm->shelved -= (uint32_t)written;
+	return written;
+}
+
+/*
+ * csm_refill - Drop a random shelf into an empty tray.
+ * @deck: Pointer to a deck in a continuous shuffler with an empty tray.
+ *
+ * The tray is left empty if every shelf is.
+ */
+static void csm_refill(Deck *deck)
+{
+	struct csm *csm = deck->csm;
+	if (csm->num_live == 0)
+		return;
+	uint32_t shelf = csm->live[draw_below(&deck->rng, csm->num_live)];
+	size_t written = csm_unload(deck, shelf, deck->head);
+	deck->tail = deck->head + written - 1;
+}
+
+/*
+ * csm_gather - Take a deck out of its continuous shuffler, keeping its cards.
+ * @deck: Pointer to the deck.
+ *
+ * Shelved cards go under the tray, shelf by shelf, so the array holds every
+ * card again.
+ */
+static void csm_gather(Deck *deck)
+{
+	struct csm *csm = deck->csm;
+	if (csm == NULL)
+		return;
+	size_t at = deck->head + tray_size(deck);
+	while (csm->num_live > 0)
+		at += csm_unload(deck, csm->live[0], at);
+	deck->tail = at - 1;
+	csm_free(deck);
+}
+
+/*
+ * deck_gen - Generate a deck (well actually a shoe) of playing cards.
+ * @packs: Number of standard 52-card packs to include.
+ *
+ * Allocates and initializes a deck with the specified number of packs,
+ * each in USPCC new deck order. The shuffle generator is seeded from rand(),
+ * use deck_gen_seeded() or deck_seed() to choose the seed and stream
+ * explicitly.
+ *
+ * Return: Pointer to the new deck, or NULL on error with errno set.
+ */
+Deck *deck_gen(int packs)
+{
+	return deck_gen_seeded(packs, random_seed(), 0);
+}
+
+/*
+ * deck_gen_seeded - Generate a shoe with a chosen shuffle seed.
+ * @packs: Number of standard 52-card packs to include.
+ * @seed: Seed of the shuffle generator.
+ * @stream: Stream id of the shuffle generator.
+ *
+ * Same as deck_gen() but never calls rand(), so worker threads can create
+ * their shoes concurrently.
+ *
+ * Return: Pointer to the new deck, or NULL on error with errno set.
+ */
+Deck *deck_gen_seeded(int packs, uint64_t seed, uint64_t stream)
+{
+	if (packs < 1) {
+		errno = EINVAL;
+		return NULL;
+	}
+	Deck *deck = deck_alloc(STANDARD_DECK_SIZE * (size_t)packs, packs, seed,
+				stream);
+	if (deck == NULL) {
+		return NULL;
+	}
+	deck_renew(deck);
+	return deck;
+}
+
+/*
+ * deck_renew - Return a generated deck to new deck order.
+ * @deck: Pointer to a deck from deck_gen().
+ *
+ * Puts every card back in the deck in USPCC new deck order, exactly as
+ * deck_gen() left it, without reallocating. The shuffle generator is left
+ * as it is.
+ *
+ * Return: 0 on success, -1 on error with errno set.
+ */
+int deck_renew(Deck *deck)
+{
+	if (deck == NULL || deck->cards == NULL || deck->packs < 1) {
+		errno = EINVAL;
+		return -1;
+	}
+	csm_free(deck);
+	size_t index = 0;
+	for (size_t i = 0; i < (size_t)deck->packs; i++) {
+		for (Suit suit = SPADES; suit <= HEARTS; suit++) {
+			for (Rank rank = ACE; rank <= KING; rank++) {
+				deck->cards[index].rank = rank;
+				deck->cards[index].suit = suit;
+				index++;
+			}
+		}
+	}
+	memset(deck->burned, 0, deck->capacity * sizeof(*deck->burned));
+	deck->discard = 0;
+	deck->played = 0;
+	deck->head = 0;
+	deck->tail = index - 1;
+	deck->counted = 0;
+	deck->running = 0;
+	return 0;
+}
+
+/*
+ * Lookup tables for parsing cards. Zero marks a character that cannot start
+ * a rank or name a suit, so suits are stored offset by one. A '1' must be
+ * followed by '0' to spell a ten.
+ */
+static const unsigned char rank_chars[256] = {
+	['A'] = ACE, ['a'] = ACE, ['2'] = TWO, ['3'] = THREE, ['4'] = FOUR,
+	['5'] = FIVE, ['6'] = SIX, ['7'] = SEVEN, ['8'] = EIGHT, ['9'] = NINE,
+	['1'] = TEN, ['T'] = TEN, ['t'] = TEN, ['J'] = JACK, ['j'] = JACK,
+	['Q'] = QUEEN, ['q'] = QUEEN, ['K'] = KING, ['k'] = KING,
+};
+static const unsigned char suit_chars[256] = {
+	['S'] = SPADES + 1, ['s'] = SPADES + 1,
+	['D'] = DIAMONDS + 1, ['d'] = DIAMONDS + 1,
+	['C'] = CLUBS + 1, ['c'] = CLUBS + 1,
+	['H'] = HEARTS + 1, ['h'] = HEARTS + 1,
+};
+static const unsigned char separator_chars[256] = {
+	[' '] = 1, ['\t'] = 1, ['\r'] = 1, ['\n'] = 1, [','] = 1,
+};
+
+/*
+ * scan_cards - Parse a run of card strings into an array of cards.
+ * @str: Text to parse, need not be NUL terminated.
+ * @len: Length of @str in bytes.
+ * @cards: Array to fill, must hold at least @len / 2 cards.
+ *
+ * Return: Number of cards parsed, or -1 on a malformed card with errno set.
+ */
+static ssize_t scan_cards(const char *str, size_t len, Card *cards)
+{
+	const unsigned char *ptr = (const unsigned char *)str;
+	const unsigned char *end = ptr + len;
+	size_t count = 0;
+	while (ptr < end) {
+		if (separator_chars[*ptr]) {
+			ptr++;
+			continue;
+		}
+		unsigned char rank = rank_chars[*ptr++];
+		if (rank == TEN && ptr[-1] == '1') {
+			if (ptr == end || *ptr != '0') {
+				errno = EINVAL;
+				return -1;
+			}
+			ptr++;
+		}
+		if (rank == 0 || ptr == end || suit_chars[*ptr] == 0) {
+			errno = EINVAL;
+			return -1;
+		}
+		cards[count].rank = (Rank)rank;
+		cards[count].suit = (Suit)(suit_chars[*ptr++] - 1);
+		count++;
+	}
+	return (ssize_t)count;
+}
+
+/*
+ * deck_parse - Parse card strings into a deck.
+ * @str: Text to parse, need not be NUL terminated.
+ * @len: Length of @str in bytes.
+ *
+ * Accepts the card_rep() format (" AS", "10H") as well as compact forms such
+ * as "TH" or "as", separated by whitespace or commas or run together, as in
+ * "AS10HKD". The first card parsed is the top of the deck.
+ *
+ * Return: Pointer to the new deck, or NULL on error with errno set to EINVAL
+ * for a malformed card or ENODATA if @str holds no cards.
+ */
+Deck *deck_parse(const char *str, size_t len)
+{
+	if (str == NULL) {
+		errno = EINVAL;
+		return NULL;
+	}
+	Deck *deck = deck_alloc(len / 2 + 1, 0, random_seed(), 0);
+	if (deck == NULL) {
+		return NULL;
+	}
+	ssize_t count = scan_cards(str, len, deck->cards);
+	if (count <= 0) {
+		if (count == 0)
+			errno = ENODATA;
+		unload_deck(deck);
+		return NULL;
+	}
+	deck->capacity = (size_t)count;
+	deck->tail = (size_t)count - 1;
+	return deck;
+}
+
+/*
+ * deck_load - Load a file of stacked shoes.
+ * @path: Path of the file to load.
+ * @shoes: Where to store the allocated array of decks.
+ * @count: Where to store the number of decks loaded.
+ *
+ * Each non-empty line of the file is parsed as one shoe by deck_parse(), and
+ * lines starting with '#' are skipped. Lines are split with memchr(), which
+ * the C library vectorises, so loading is dominated by the card scan itself.
+ * Free each deck with unload_deck() and the array with free().
+ *
+ * Return: 0 on success, -1 on error with errno set.
+ */
+int deck_load(const char *path, Deck ***shoes, size_t *count)
+{
+	if (path == NULL || shoes == NULL || count == NULL) {
+		errno = EINVAL;
+		return -1;
+	}
+	FILE *file = fopen(path, "rb");
+	if (file == NULL) {
+		return -1;
+	}
+	char *text = NULL;
+	size_t len = 0;
+	size_t cap = 0;
+	for (;;) {
+		if (cap - len < BUFSIZ) {
+			cap = cap ? cap * 2 : 4 * BUFSIZ;
+			char *grown = realloc(text, cap);
+			if (grown == NULL) {
+				free(text);
+				fclose(file);
+				errno = ENOMEM;
+				return -1;
+			}
+			text = grown;
+		}
+		size_t got = fread(text + len, 1, cap - len, file);
+		len += got;
+		if (got == 0)
+			break;
+	}
+	if (ferror(file)) {
+		free(text);
+		fclose(file);
+		errno = EIO;
+		return -1;
+	}
+	fclose(file);
+
+	Deck **decks = NULL;
+	size_t num_decks = 0;
+	size_t max_decks = 0;
+	const char *line = text;
+	const char *end = text + len;
+	while (line < end) {
+		const char *eol = memchr(line, '\n', (size_t)(end - line));
+		if (eol == NULL)
+			eol = end;
+		size_t line_len = (size_t)(eol - line);
+		const char *next = eol + 1;
+		while (line_len > 0 && separator_chars[(unsigned char)*line]) {
+			line++;
+			line_len--;
+		}
+		if (line_len == 0 || *line == '#') {
+			line = next;
+			continue;
+		}
+		if (num_decks == max_decks) {
+			max_decks = max_decks ? max_decks * 2 : 16;
+			Deck **grown = realloc(decks, max_decks * sizeof(*decks));
+			if (grown == NULL) {
+				errno = ENOMEM;
+				goto fail;
+			}
+			decks = grown;
+		}
+		decks[num_decks] = deck_parse(line, line_len);
+		if (decks[num_decks] == NULL)
+			goto fail;
+		num_decks++;
+		line = next;
+	}
+	free(text);
+	*shoes = decks;
+	*count = num_decks;
+	return 0;
+fail:
+	free(text);
+	for (size_t i = 0; i < num_decks; i++)
+		unload_deck(decks[i]);
+	free(decks);
+	return -1;
+}
+
+/*
+ * deck_seed - Seed the generator used to shuffle a deck.
+ * @deck: Pointer to the deck.
+ * @seed: Seed to record and seed the generator with.
+ * @stream: Stream id to record and seed the generator with.
+ *
+ * Return: 0 on success, -1 on error with errno set.
+ */
+int deck_seed(Deck *deck, uint64_t seed, uint64_t stream)
+{
+	if (deck == NULL) {
+		errno = EINVAL;
+		return -1;
+	}
+	deck->seed = seed;
+	deck->stream = stream;
+	rng_seed(&deck->rng, seed, stream);
+	deck->shuffles = 0;
+	return 0;
+}
+
+/*
+ * deck_get_seed - Get the seed and stream id recorded for a deck.
+ * @deck: Pointer to the deck.
+ * @seed: Where to store the seed, may be NULL.
+ * @stream: Where to store the stream id, may be NULL.
+ *
+ * Return: 0 on success, -1 on error with errno set.
+ */
+int deck_get_seed(const Deck *deck, uint64_t *seed, uint64_t *stream)
+{
+	if (deck == NULL) {
+		errno = EINVAL;
+		return -1;
+	}
+	if (seed != NULL)
+		*seed = deck->seed;
+	if (stream != NULL)
+		*stream = deck->stream;
+	return 0;
+}
+
+/*
+ * deck_replay - Regenerate a shuffled deck from its recorded seed.
+ * @packs: Number of standard 52-card packs in the deck.
+ * @seed: Seed recorded for the deck.
+ * @stream: Stream id recorded for the deck.
+ *
+ * The returned deck is identical, card for card, to any other deck generated
+ * and shuffled once with the same @packs, @seed and @stream.
+ *
+ * Return: Pointer to the new deck, or NULL on error with errno set.
+ */
+Deck *deck_replay(int packs, uint64_t seed, uint64_t stream)
+{
+	return deck_replay_shoe(packs, seed, stream, 1);
+}
+
+/*
+ * deck_replay_shoe - Regenerate a later shoe of a seeded deck.
+ * @packs: Number of standard 52-card packs in the deck.
+ * @seed: Seed recorded for the deck.
+ * @stream: Stream id recorded for the deck.
+ * @shuffles: Shuffles of the deck since it was seeded.
+ *
+ * A shoe gathered with deck_restack() keeps its cards in their last order,
+ * so each reshuffle starts from the shoe before it. The deck is generated
+ * and shuffled, then restacked and shuffled again until it has been
+ * shuffled @shuffles times, which rebuilds any shoe of a deck reshuffled
+ * that way, card for card. Shoes reshuffled any other way cannot be
+ * rebuilt.
+ *
+ * Return: Pointer to the new deck, or NULL on error with errno set.
+ */
+Deck *deck_replay_shoe(int packs, uint64_t seed, uint64_t stream,
+		       size_t shuffles)
+{
+	Deck *deck = deck_gen_seeded(packs, seed, stream);
+	if (deck == NULL) {
+		return NULL;
+	}
+	for (size_t i = 0; i < shuffles; i++) {
+		deck_restack(deck);
+		deck_shuffle(deck);
+	}
+	return deck;
+}
+
+/*
+ * file_write_atomic - Replace a file's contents atomically.
+ * @path: Path of the file to write.
+ * @data: Contents to write.
+ * @size: Size of @data in bytes.
+ *
+ * Writes to a temporary file next to @path, syncs it and renames it over
+ * @path, so readers see either the old or the new contents in full.
+ *
+ * Return: 0 on success, -1 on error with errno set.
+ */
+int file_write_atomic(const char *path, const void *data, size_t size)
+{
+	if (path == NULL || (data == NULL && size > 0)) {
+		errno = EINVAL;
+		return -1;
+	}
+	size_t path_len = strlen(path);
+	char *tmp_path = malloc(path_len + sizeof(".tmp"));
+	if (tmp_path == NULL) {
+		errno = ENOMEM;
+		return -1;
+	}
+	memcpy(tmp_path, path, path_len);
+	memcpy(tmp_path + path_len, ".tmp", sizeof(".tmp"));
+	int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		free(tmp_path);
+		return -1;
+	}
+	const char *ptr = data;
+	size_t left = size;
+	while (left > 0) {
+		ssize_t written = write(fd, ptr, left);
+		if (written < 0) {
+			if (errno == EINTR)
+				continue;
+			goto fail;
+		}
+		ptr += written;
+		left -= (size_t)written;
+	}
+	if (fsync(fd) < 0)
+		goto fail;
+	if (close(fd) < 0) {
+		fd = -1;
+		goto fail;
+	}
+	if (rename(tmp_path, path) < 0) {
+		fd = -1;
+		goto fail;
+	}
+	free(tmp_path);
+	return 0;
+fail:;
+	int saved = errno;
+	if (fd >= 0)
+		close(fd);
+	unlink(tmp_path);
+	free(tmp_path);
+	errno = saved;
+	return -1;
+}
+
+/*
+ * table_checksum - Hash the payload of a table file.
+ * @data: Payload to hash.
+ * @size: Size of @data in bytes.
+ *
+ * Return: 64-bit FNV-1a hash of @data.
+ */
+static uint64_t table_checksum(const void *data, size_t size)
+{
+	const unsigned char *bytes = data;
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	for (size_t i = 0; i < size; i++) {
+		hash ^= bytes[i];
+		hash *= 0x100000001b3ULL;
+	}
+	return hash;
+}
+
+/*
+ * table_write - Write a precomputed table file.
+ * @path: Path of the file to write.
+ * @magic: Magic string naming the table, up to 7 characters.
+ * @version: Format version of the payload.
+ * @data: Payload to store.
+ * @size: Size of @data in bytes.
+ *
+ * The file is written with file_write_atomic(), so processes mapping it with
+ * table_map() never see a partial table.
+ *
+ * Return: 0 on success, -1 on error with errno set.
+ */
+int table_write(const char *path, const char *magic, uint32_t version,
+		const void *data, size_t size)
+{
+	struct table_header header = { .version = version,
+					.byte_order = TABLE_BYTE_ORDER,
+					.size = size };
+	if (path == NULL || magic == NULL ||
+	    strlen(magic) >= sizeof(header.magic) ||
+	    (data == NULL && size > 0)) {
+		errno = EINVAL;
+		return -1;
+	}
+	strncpy(header.magic, magic, sizeof(header.magic));
+	header.checksum = table_checksum(data, size);
+	unsigned char *image = malloc(sizeof(header) + size);
+	if (image == NULL) {
+		errno = ENOMEM;
+		return -1;
+	}
+	memcpy(image, &header, sizeof(header));
+	if (size > 0)
+		memcpy(image + sizeof(header), data, size);
+	int ret = file_write_atomic(path, image, sizeof(header) + size);
+	free(image);
+	return ret;
+}
+
+/*
+ * table_map - Map a precomputed table file read-only.
+ * @path: Path of the file written by table_write().
+ * @magic: Magic string the file must carry.
+ * @version: Format version the file must carry.
+ * @size: Where to store the size of the payload in bytes.
+ *
+ * The file is mapped shared, so every process mapping the same table shares
+ * its pages. The magic, version, byte order, size and checksum are checked
+ * before the payload is returned. Release it with table_unmap().
+ *
+ * Return: Pointer to the payload, or NULL on error with errno set to EBADMSG
+ * for a corrupt, stale or foreign file, or another error code.
+ */
+const void *table_map(const char *path, const char *magic, uint32_t version,
+		      size_t *size)
+{
+	if (path == NULL || magic == NULL || size == NULL) {
+		errno = EINVAL;
+		return NULL;
+	}
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		return NULL;
+	}
+	struct stat st;
+	if (fstat(fd, &st) < 0) {
+		close(fd);
+		return NULL;
+	}
+	size_t length = (size_t)st.st_size;
+	if (length < sizeof(struct table_header)) {
+		close(fd);
+		errno = EBADMSG;
+		return NULL;
+	}
+	unsigned char *image = mmap(NULL, length, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (image == MAP_FAILED) {
+		return NULL;
+	}
+	const struct table_header *header = (const void *)image;
+	const unsigned char *payload = image + sizeof(*header);
+	if (strncmp(header->magic, magic, sizeof(header->magic)) != 0 ||
+	    header->version != version ||
+	    header->byte_order != TABLE_BYTE_ORDER ||
+	    header->size != length - sizeof(*header) ||
+	    header->checksum != table_checksum(payload, header->size)) {
+		munmap(image, length);
+		errno = EBADMSG;
+		return NULL;
+	}
+	*size = header->size;
+	return payload;
+}
+
+/*
+ * table_unmap - Release a table mapped by table_map().
+ * @data: Payload returned by table_map().
+ * @size: Size of the payload returned by table_map().
+ *
+ * Return: 0 on success, -1 on error with errno set.
+ */
+int table_unmap(const void *data, size_t size)
+{
+	if (data == NULL) {
+		errno = EINVAL;
+		return -1;
+	}
+	const unsigned char *image = (const unsigned char *)data -
+				     sizeof(struct table_header);
+	return munmap((void *)image, size + sizeof(struct table_header));
+}
+
+/*
+ * hand_length - Count the cards in a hand.
+ * @hand: Hand to count, may be NULL for an empty hand.
+ *
+ * Return: Number of cards in the hand.
+ */
+static size_t hand_length(const Hand *hand)
+{
+	size_t length = 0;
+	for (const Hand *ptr = hand; ptr != NULL; ptr = ptr->next)
+		length++;
+	return length;
+}
+
+/*
+ * cards_valid - Check that cards have a real rank and suit.
+ * @cards: Cards to check.
+ * @count: Number of cards in @cards.
+ *
+ * Return: 1 if every card is a real card, 0 otherwise.
+ */
+static _Bool cards_valid(const Card *cards, size_t count)
+{
+	for (size_t i = 0; i < count; i++) {
+		if ((int)cards[i].rank < ACE || (int)cards[i].rank > KING ||
+		    (int)cards[i].suit < SPADES || (int)cards[i].suit > HEARTS)
+			return 0;
+	}
+	return 1;
+}
+
+/*
+ * deck_snapshot - Write a binary snapshot of a shoe and its table state.
+ * @path: Path of the snapshot file, replaced atomically.
+ * @deck: Deck to save, including its shuffle generator state.
+ * @hands: Hands to save, entries may be NULL for empty hands.
+ * @num_hands: Number of entries in @hands.
+ * @counts: Counters to save alongside, such as a running count.
+ * @num_counts: Number of entries in @counts.
+ *
+ * Return: 0 on success, -1 on error with errno set to EINVAL, including for a
+ * deck loaded in a continuous shuffler, or as the write failed.
+ */
+int deck_snapshot(const char *path, const Deck *deck, Hand *const *hands,
+		  size_t num_hands, const int64_t *counts, size_t num_counts)
+{
+	if (path == NULL || deck == NULL || deck->cards == NULL ||
+	    deck->csm != NULL || (hands == NULL && num_hands > 0) ||
+	    (counts == NULL && num_counts > 0)) {
+		errno = EINVAL;
+		return -1;
+	}
+	size_t num_cards = deck->capacity;
+	size_t hand_cards = 0;
+	for (size_t i = 0; i < num_hands; i++)
+		hand_cards += hand_length(hands[i]);
+	size_t size = sizeof(struct snapshot_header) +
+		      num_counts * sizeof(int64_t) +
+		      num_hands * sizeof(uint64_t) +
+		      (num_cards + hand_cards) * sizeof(Card) + num_cards;
+	unsigned char *image = calloc(1, size);
+	if (image == NULL) {
+		errno = ENOMEM;
+		return -1;
+	}
+	struct snapshot_header *header = (struct snapshot_header *)image;
+	memcpy(header->magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+	header->version = SNAPSHOT_VERSION;
+	header->card_size = sizeof(Card);
+	header->num_cards = num_cards;
+	header->discard = deck->discard;
+	header->played = deck->played;
+	header->head = deck->head;
+	header->tail = deck->tail;
+	header->packs = deck->packs;
+	header->seed = deck->seed;
+	header->stream = deck->stream;
+	header->rng = deck->rng;
+	header->shuffles = deck->shuffles;
+	header->num_hands = num_hands;
+	header->num_counts = num_counts;
+
+	unsigned char *ptr = image + sizeof(*header);
+	if (num_counts > 0)
+		memcpy(ptr, counts, num_counts * sizeof(int64_t));
+	ptr += num_counts * sizeof(int64_t);
+	for (size_t i = 0; i < num_hands; i++) {
+		uint64_t length = hand_length(hands[i]);
+		memcpy(ptr, &length, sizeof(length));
+		ptr += sizeof(length);
+	}
+	memcpy(ptr, deck->cards, num_cards * sizeof(Card));
+	ptr += num_cards * sizeof(Card);
+	for (size_t i = 0; i < num_hands; i++) {
+		for (const Hand *hand = hands[i]; hand != NULL; hand = hand->next) {
+			memcpy(ptr, &hand->card, sizeof(Card));
+			ptr += sizeof(Card);
+		}
+	}
+	for (size_t i = 0; i < num_cards; i++)
+		*ptr++ = deck->burned[i];
+	int ret = file_write_atomic(path, image, size);
+	free(image);
+	return ret;
+}
+
+/*
+ * deck_restore - Restore a shoe and its table state from a snapshot.
+ * @path: Path of the snapshot file.
+ * @hands: Array to store the restored hands in, may be NULL if @num_hands
+ *         points to 0.
+ * @num_hands: Capacity of @hands on entry, number of hands restored on exit.
+ * @counts: Array to store the restored counters in, may be NULL if
+ *          @num_counts points to 0.
+ * @num_counts: Capacity of @counts on entry, number restored on exit.
+ *
+ * The snapshot is memory mapped and each section is copied out whole, so no
+ * card is parsed. Restored hands keep their original card order and must be
+ * freed with unload_hand().
+ *
+ * Return: Pointer to the restored deck, or NULL on error with errno set to
+ * EBADMSG for a corrupt or incompatible snapshot, ENOBUFS if @hands or @counts
+ * are too small, or another error code.
+ */
+Deck *deck_restore(const char *path, Hand **hands, size_t *num_hands,
+		   int64_t *counts, size_t *num_counts)
+{
+	if (path == NULL || num_hands == NULL || num_counts == NULL ||
+	    (hands == NULL && *num_hands > 0) ||
+	    (counts == NULL && *num_counts > 0)) {
+		errno = EINVAL;
+		return NULL;
+	}
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		return NULL;
+	}
+	struct stat st;
+	if (fstat(fd, &st) < 0) {
+		close(fd);
+		return NULL;
+	}
+	size_t size = (size_t)st.st_size;
+	if (size < sizeof(struct snapshot_header)) {
+		close(fd);
+		errno = EBADMSG;
+		return NULL;
+	}
+	unsigned char *image = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (image == MAP_FAILED) {
+		return NULL;
+	}
+	Deck *deck = NULL;
+	const struct snapshot_header *header = (const void *)image;
+	if (memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0 ||
+	    header->version != SNAPSHOT_VERSION ||
+	    header->card_size != sizeof(Card) || header->num_cards == 0 ||
+	    header->discard > header->played || header->played > header->head ||
+	    header->head > header->tail + 1 ||
+	    header->tail + 1 - header->discard != header->num_cards ||
+	    header->tail >= 2 * header->num_cards ||
+	    header->packs < 0 || header->packs > INT_MAX ||
+	    (header->packs != 0 &&
+	     header->num_cards != STANDARD_DECK_SIZE * (uint64_t)header->packs)) {
+		errno = EBADMSG;
+		goto out;
+	}
+	if (header->num_hands > *num_hands || header->num_counts > *num_counts) {
+		errno = ENOBUFS;
+		goto out;
+	}
+	// Check each section against the bytes left before stepping over it
+	const unsigned char *ptr = image + sizeof(*header);
+	size_t left = size - sizeof(*header);
+	if (header->num_counts > left / sizeof(int64_t)) {
+		errno = EBADMSG;
+		goto out;
+	}
+	left -= header->num_counts * sizeof(int64_t);
+	if (header->num_hands > left / sizeof(uint64_t)) {
+		errno = EBADMSG;
+		goto out;
+	}
+	left -= header->num_hands * sizeof(uint64_t);
+	const unsigned char *lengths = ptr + header->num_counts * sizeof(int64_t);
+	const unsigned char *cards = lengths + header->num_hands * sizeof(uint64_t);
+	// The deck's cards and their burned flags come before the hands' cards
+	if (header->num_cards > left / (sizeof(Card) + 1)) {
+		errno = EBADMSG;
+		goto out;
+	}
+	left -= header->num_cards * (sizeof(Card) + 1);
+	size_t hand_cards = 0;
+	for (size_t i = 0; i < header->num_hands; i++) {
+		uint64_t length;
+		memcpy(&length, lengths + i * sizeof(length), sizeof(length));
+		if (length > left / sizeof(Card)) {
+			errno = EBADMSG;
+			goto out;
+		}
+		left -= length * sizeof(Card);
+		hand_cards += length;
+	}
+	if (left != 0 ||
+	    !cards_valid((const Card *)cards, header->num_cards + hand_cards)) {
+		errno = EBADMSG;
+		goto out;
+	}
+
+	deck = deck_alloc(header->num_cards, (int)header->packs,
+			  header->seed, header->stream);
+	if (deck == NULL)
+		goto out;
+	memcpy(deck->cards, cards, header->num_cards * sizeof(Card));
+	const unsigned char *burned = cards +
+		(header->num_cards + hand_cards) * sizeof(Card);
+	for (size_t i = 0; i < header->num_cards; i++)
+		deck->burned[i] = burned[i] != 0;
+	deck->discard = header->discard;
+	deck->played = header->played;
+	deck->head = header->head;
+	deck->tail = header->tail;
+	deck->counted = deck->discard; // The count is caught up from the tray
+	deck->rng = header->rng; // Resume the stream where it was saved
+	deck->shuffles = header->shuffles;
+	if (header->num_counts > 0)
+		memcpy(counts, ptr, header->num_counts * sizeof(int64_t));
+
+	// Hands were written top card first, so push them back bottom first
+	const Card *hand_card = (const Card *)cards + header->num_cards;
+	for (size_t i = 0; i < header->num_hands; i++) {
+		uint64_t length;
+		memcpy(&length, lengths + i * sizeof(length), sizeof(length));
+		hands[i] = NULL;
+		for (size_t j = length; j > 0; j--) {
+			Hand *node = malloc(sizeof(Hand));
+			if (node == NULL) {
+				for (size_t k = 0; k <= i; k++)
+					unload_hand(hands[k]);
+				unload_deck(deck);
+				deck = NULL;
+				errno = ENOMEM;
+				goto out;
+			}
+			memcpy(&node->card, &hand_card[j - 1], sizeof(Card));
+			node->next = hands[i];
+			hands[i] = node;
+		}
+		hand_card += length;
+	}
+	*num_hands = header->num_hands;
+	*num_counts = header->num_counts;
+out:;
+	int saved = errno;
+	munmap(image, size);
+	errno = saved;
+	return deck;
+}
+
+/*
+ * deck_size - Calculate the number of playing cards in a deck.
+ * @deck: Pointer to the deck.
+ *
+ * Return: Number of cards in the deck, or maximum size_t value on error with
+ * errno set.
+ */
+size_t deck_size(const Deck *deck)
+{
+	if (deck == NULL || deck->cards == NULL) {
+		errno = EINVAL;
+		return (size_t)-1; // Maximum value to represent error
+	}
+	size_t size = tray_size(deck);
+	if (deck->csm != NULL)
+		size += deck->csm->shelved;
+	return size;
+}
+
+/*
+ * shuffle_below - Shuffle the bottom of a deck.
+ * @deck: Pointer to the deck.
+ * @from: Position of the highest card to shuffle, the rest down to @tail
+ *        are shuffled with it.
+ */
+static void shuffle_below(Deck *deck, size_t from)
+{
+	for (size_t i = deck->tail; i > from; i--) {
+		size_t random_card = ring_index(deck, from +
+			rng_bounded(&deck->rng, (uint32_t)(i - from + 1)));
+		size_t index = ring_index(deck, i);
+		struct card tmp_card = deck->cards[index];
+		deck->cards[index] = deck->cards[random_card];
+		deck->cards[random_card] = tmp_card;
+	}
+}
+
+/**
+ * deck_shuffle - Shuffle a deck of playing cards.
+ * @deck: Pointer to the deck to shuffle.
+ *
+ * Shuffles the remaining cards in the deck using the Fisher-Yates algorithm,
+ * drawing from the generator seeded with deck_seed().
+ *
+ * Return: 0 on success, -1 on error with errno set.
+ */
+int deck_shuffle(Deck *deck)
+{
+	if (deck == NULL || deck->cards == NULL) {
+		errno = EINVAL;
+		return -1;
+	}
+	shuffle_below(deck, deck->head);
+	deck->shuffles++;
+	return 0;
+}
+
+/*
+ * binomial_half - Draw from a binomial distribution with p = 1/2.
+ * @rng: Generator to draw from.
+ * @n: Number of trials.
+ *
+ * Return: Number of set bits among @n random bits.
+ */
+static size_t binomial_half(Rng *rng, size_t n)
+{
+	size_t count = 0;
+	for (; n >= 32; n -= 32)
+		count += (size_t)__builtin_popcount(rng_next(rng));
+	if (n > 0)
+		count += (size_t)__builtin_popcount(rng_next(rng) &
+						    ((1u << n) - 1));
+	return count;
+}
+
+/*
+ * riffle - Riffle a stack of cards by the Gilbert-Shannon-Reeds model.
+ * @cards: Cards to riffle, top first.
+ * @n: Number of cards.
+ * @scratch: Space for @n cards.
+ * @rng: Generator to draw from.
+ *
+ * A GSR riffle is the same as reading @n random bits: how many are set is
+ * the binomial cut, and given the cut every order of drops is equally
+ * likely. The bits are counted for the cut, then the generator is rewound
+ * and the same bits replayed as drops, so one draw decides 32 cards. The
+ * top half is merged back over the bottom half in place, choosing each card
+ * by masking the two source addresses, since a branch on a random bit
+ * mispredicts half the time.
+ */
+static void riffle(Card *cards, size_t n, Card *scratch, Rng *rng)
+{
+	Rng start = *rng;
+	size_t cut = binomial_half(rng, n);
+	*rng = start;
+	memcpy(scratch, cards, cut * sizeof(*cards));
+	size_t left = 0, right = cut, out = 0;
+	uint32_t bits = 0;
+	while (left < cut && right < n) {
+		if (out % 32 == 0)
+			bits = rng_next(rng);
+		size_t take = bits & 1;
+		bits >>= 1;
+		uintptr_t mask = -(uintptr_t)take; // A select compilers keep
+		const Card *from = (const Card *)(((uintptr_t)(scratch + left) &
+						   mask) |
+						  ((uintptr_t)(cards + right) &
+						   ~mask));
+		cards[out++] = *from;
+		left += take;
+		right += take ^ 1;
+	}
+	memcpy(cards + out, scratch + left, (cut - left) * sizeof(*cards));
+	for (size_t drawn = (out + 31) / 32; drawn < (n + 31) / 32; drawn++)
+		rng_next(rng); // Leave the generator past every bit
+}
+
+/*
+ * strip - Strip a stack of cards into a new pile.
+ * @cards: Cards to strip, top first.
+ * @n: Number of cards.
+ * @scratch: Space for @n cards.
+ * @rng: Generator to draw from.
+ * @size: Mean packet size, at most @n, packets are uniform from 1 to
+ *        2 * @size - 1.
+ *
+ * Packets come off the top and land on the new pile, so their order is
+ * reversed while each packet keeps its own.
+ */
+static void strip(Card *cards, size_t n, Card *scratch, Rng *rng,
+		  unsigned size)
+{
+	memcpy(scratch, cards, n * sizeof(*cards));
+	size_t top = 0, end = n;
+	while (top < n) {
+		size_t packet = 1 + draw_below(rng, 2 * size - 1);
+		if (packet > n - top)
+			packet = n - top;
+		end -= packet;
+		memcpy(cards + end, scratch + top, packet * sizeof(*cards));
+		top += packet;
+	}
+}
+
+/*
+ * box - Box a stack of cards.
+ * @cards: Cards to box, top first.
+ * @n: Number of cards.
+ * @scratch: Space for @n cards.
+ * @rng: Generator to draw from.
+ * @packets: Number of packets, at most @n.
+ *
+ * The stack is split into @packets packets of about equal size, each split
+ * off by up to a quarter packet, and they are stacked in reverse order.
+ */
+static void box(Card *cards, size_t n, Card *scratch, Rng *rng,
+		unsigned packets)
+{
+	memcpy(scratch, cards, n * sizeof(*cards));
+	size_t jitter = n / (4 * (size_t)packets);
+	size_t top = 0, end = n;
+	for (unsigned i = 1; i <= packets; i++) {
+		size_t next = n;
+		if (i < packets) {
+			next = n * i / packets - jitter +
+			       draw_below(rng, (uint32_t)(2 * jitter + 1));
+			if (next < top)
+				next = top;
+		}
+		end -= next - top;
+		memcpy(cards + end, scratch + top, (next - top) * sizeof(*cards));
+		top = next;
+	}
+}
+
+/*
+ * plug - Plug the bottom of a stack of cards back in.
+ * @cards: Cards to plug, top first.
+ * @n: Number of cards.
+ * @scratch: Space for @size cards.
+ * @rng: Generator to draw from.
+ * @size: Cards taken from the bottom, at most @n.
+ */
+static void plug(Card *cards, size_t n, Card *scratch, Rng *rng,
+		 unsigned size)
+{
+	size_t depth = draw_below(rng, (uint32_t)(n - size + 1));
+	memcpy(scratch, cards + n - size, size * sizeof(*cards));
+	memmove(cards + depth + size, cards + depth,
+		(n - size - depth) * sizeof(*cards));
+	memcpy(cards + depth, scratch, size * sizeof(*cards));
+}
+
+/*
+ * cut - Cut a stack of cards at a binomial point.
+ * @cards: Cards to cut, top first.
+ * @n: Number of cards.
+ * @scratch: Space for @n cards.
+ * @rng: Generator to draw from.
+ */
+static void cut(Card *cards, size_t n, Card *scratch, Rng *rng)
+{
+	size_t top = binomial_half(rng, n);
+	memcpy(scratch, cards, top * sizeof(*cards));
+	memmove(cards, cards + top, (n - top) * sizeof(*cards));
+	memcpy(cards + n - top, scratch, top * sizeof(*cards));
+}
+
+/*
+ * deck_procedure - Shuffle a deck by a casino shuffle procedure.
+ * @deck: Pointer to the deck to shuffle.
+ * @steps: Steps of the procedure, in order.
+ * @num_steps: Number of steps.
+ *
+ * Unlike deck_shuffle(), which leaves every order equally likely, the
+ * remaining cards go through the riffles, strips, boxes, plugs and cuts of
+ * a real procedure, keeping the structure a shuffle tracker exploits. Steps
+ * draw from the generator seeded with deck_seed(), so a procedure replays
+ * exactly. Packets move with memcpy() and riffles merge without branching
+ * on the drops. The size of a strip, box or plug must be from 1 to the
+ * number of cards left.
+ *
+ * Return: 0 on success, -1 on error with errno set.
+ */
+int deck_procedure(Deck *deck, const ShuffleStep *steps, size_t num_steps)
+{
+	if (deck == NULL || deck->cards == NULL ||
+	    (steps == NULL && num_steps > 0)) {
+		errno = EINVAL;
+		return -1;
+	}
+	size_t n = tray_size(deck);
+	for (size_t i = 0; i < num_steps; i++) {
+		_Bool sized = steps[i].op == SHUFFLE_STRIP ||
+			      steps[i].op == SHUFFLE_BOX ||
+			      steps[i].op == SHUFFLE_PLUG;
+		if (steps[i].op > SHUFFLE_CUT ||
+		    (sized && (steps[i].size == 0 || steps[i].size > n))) {
+			errno = EINVAL;
+			return -1;
+		}
+	}
+	if (n < 2)
+		return 0;
+	Card *scratch = malloc(n * sizeof(*scratch));
+	if (scratch == NULL) {
+		errno = ENOMEM;
+		return -1;
+	}
+	ring_unwrap(deck);
+	Card *cards = deck->cards + deck->head;
+	for (size_t i = 0; i < num_steps; i++) {
+		for (unsigned t = 0; t < steps[i].times; t++) {
+			switch (steps[i].op) {
+			case SHUFFLE_RIFFLE:
+				riffle(cards, n, scratch, &deck->rng);
+				break;
+			case SHUFFLE_STRIP:
+				strip(cards, n, scratch, &deck->rng, steps[i].size);
+				break;
+			case SHUFFLE_BOX:
+				box(cards, n, scratch, &deck->rng, steps[i].size);
+				break;
+			case SHUFFLE_PLUG:
+				plug(cards, n, scratch, &deck->rng, steps[i].size);
+				break;
+			case SHUFFLE_CUT:
+				cut(cards, n, scratch, &deck->rng);
+				break;
+			}
+		}
+	}
+	free(scratch);
+	return 0;
+}
+
+/*
+ * deck_restack - Return every dealt card to a deck.
+ * @deck: Pointer to the deck.
+ *
+ * The discard tray goes back on top, oldest discard first, followed by the
+ * cards still in play in the order they were dealt, ready for
+ * deck_shuffle(). Hands holding those cards are unaffected.
+ *
+ * Return: 0 on success, -1 on error with errno set.
+ */
+int deck_restack(Deck *deck)
+{
+	if (deck == NULL || deck->cards == NULL) {
+		errno = EINVAL;
+		return -1;
+	}
+	csm_gather(deck);
+	ring_unwrap(deck);
+	memset(deck->burned, 0, deck->capacity * sizeof(*deck->burned));
+	deck->discard = 0;
+	deck->played = 0;
+	deck->head = 0;
+	deck->counted = 0;
+	deck->running = 0;
+	return 0;
+}
+
+/*
+ * deck_csm - Load a deck into a continuous shuffling machine.
+ * @deck: Pointer to the deck.
+ * @shelves: Number of shelves in the machine.
+ *
+ * Every card, dealt or not, is restacked and shelved on a random shelf, and
+ * one random shelf is dropped into the tray. Dealing takes cards from the
+ * tray and drops another random shelf in whenever it empties, and
+ * deck_csm_return() shelves the cards of finished rounds again, so the deck
+ * never needs reshuffling. deck_restack() and deck_renew() take the deck
+ * back out of the machine. Only the tray is in the array, so a deck in a
+ * machine cannot be snapshotted and its rounds cannot be replayed.
+ *
+ * Return: 0 on success, -1 on error with errno set.
+ */
+int deck_csm(Deck *deck, unsigned shelves)
+{
+	if (deck == NULL || deck->cards == NULL || shelves == 0) {
+		errno = EINVAL;
+		return -1;
+	}
+	deck_restack(deck);
+	size_t capacity = deck->capacity;
+	if (capacity >= CSM_NONE) {
+		errno = EINVAL;
+		return -1;
+	}
+	struct csm *csm = calloc(1, sizeof(*csm));
+	if (csm == NULL) {
+		errno = ENOMEM;
+		return -1;
+	}
+	csm->shelves = shelves;
+	csm->capacity = (uint32_t)capacity;
+	csm->top = malloc(shelves * sizeof(*csm->top));
+	csm->count = calloc(shelves, sizeof(*csm->count));
+	csm->live = malloc(shelves * sizeof(*csm->live));
+	csm->where = malloc(shelves * sizeof(*csm->where));
+	csm->slots = malloc(capacity * sizeof(*csm->slots));
+	csm->next = malloc(capacity * sizeof(*csm->next));
+	deck->csm = csm;
+	if (csm->top == NULL || csm->count == NULL || csm->live == NULL ||
+	    csm->where == NULL || csm->slots == NULL || csm->next == NULL) {
+		csm_free(deck);
+		errno = ENOMEM;
+		return -1;
+	}
+	for (uint32_t shelf = 0; shelf < shelves; shelf++)
+		csm->top[shelf] = CSM_NONE;
+	for (uint32_t slot = 0; slot < csm->capacity; slot++)
+		csm->next[slot] = slot + 1 < csm->capacity ? slot + 1 : CSM_NONE;
+	for (size_t i = 0; i < capacity; i++)
+		csm_shelve(csm, &deck->rng, deck->cards[i]);
+	deck->head = 0;
+	csm_refill(deck);
+	return 0;
+}
+
+/*
+ * deck_csm_return - Feed the cards dealt from a deck back into its machine.
+ * @deck: Pointer to a deck loaded with deck_csm().
+ *
+ * Call once a round is over and its hands are discarded. Each dealt card,
+ * burned, discarded or still in play, goes onto a random shelf in O(1), and
+ * the cards left in the tray move to the front of the array, so the deck
+ * never grows. The Hi-Lo count starts again, as cards come back before the
+ * next round.
+ *
+ * Return: 0 on success, -1 on error with errno set.
+ */
+int deck_csm_return(Deck *deck)
+{
+	if (deck == NULL || deck->cards == NULL || deck->csm == NULL) {
+		errno = EINVAL;
+		return -1;
+	}
+	for (size_t i = 0; i < deck->head; i++)
+		csm_shelve(deck->csm, &deck->rng, deck->cards[i]);
+	size_t tray = tray_size(deck);
+	memmove(deck->cards, deck->cards + deck->head,
+		tray * sizeof(*deck->cards));
+	memset(deck->burned, 0, deck->head * sizeof(*deck->burned));
+	deck->discard = 0;
+	deck->played = 0;
+	deck->head = 0;
+	deck->counted = 0;
+	deck->running = 0;
+	if (tray > 0)
+		deck->tail = tray - 1;
+	else
+		csm_refill(deck);
+	return 0;
+}
+
+/*
+ * deck_burn - Burn cards from the top of a deck.
+ * @deck: Pointer to the deck.
+ * @count: Number of cards to burn.
+ *
+ * Each card goes face down onto the discard tray, under any cards still in
+ * play, and is never seen by deck_count(). A burn mid-round moves the cards
+ * in play up one place to make room.
+ *
+ * Return: 0 on success, -1 on error with errno set to EINVAL or ENODATA if
+ * the deck runs out, with the cards before that left burned.
+ */
+int deck_burn(Deck *deck, size_t count)
+{
+	if (deck == NULL || deck->cards == NULL) {
+		errno = EINVAL;
+		return -1;
+	}
+	count_up(deck);
+	for (size_t i = 0; i < count; i++) {
+		if (deck->head > deck->tail) {
+			errno = ENODATA;
+			return -1;
+		}
+		Card card = deck->cards[ring_index(deck, deck->head)];
+		for (size_t j = deck->head; j > deck->played; j--)
+			deck->cards[ring_index(deck, j)] =
+				deck->cards[ring_index(deck, j - 1)];
+		size_t index = ring_index(deck, deck->played++);
+		deck->cards[index] = card;
+		deck->burned[index] = 1;
+		deck->head++;
+		deck->counted++;
+		if (deck->head > deck->tail && deck->csm != NULL)
+			csm_refill(deck);
+	}
+	return 0;
+}
+
+/*
+ * deck_discard - Pick a hand up into a deck's discard tray.
+ * @deck: Pointer to the deck the hand was dealt from.
+ * @hand: Hand to pick up, or NULL to pick up every card still in play in
+ *        the order they were dealt.
+ *
+ * The tray keeps the order the dealer picks cards up in, which once a round
+ * has several hands differs from the order they were dealt. Each card of
+ * @hand is found among the cards in play and swapped onto the tray in place.
+ *
+ * Return: 0 on success, -1 on error with errno set to EINVAL, including if a
+ * card of @hand is not in play. The tray is then left as it was, though the
+ * cards in play may have been reordered.
+ */
+int deck_discard(Deck *deck, const Hand *hand)
+{
+	if (deck == NULL || deck->cards == NULL) {
+		errno = EINVAL;
+		return -1;
+	}
+	if (hand == NULL) {
+		deck->played = deck->head;
+		return 0;
+	}
+	count_up(deck); // Swapping counted and uncounted cards would skew it
+	size_t top = deck->played;
+	for (; hand != NULL; hand = hand->next) {
+		size_t i = top;
+		while (i < deck->head) {
+			const Card *card = &deck->cards[ring_index(deck, i)];
+			if (card->rank == hand->card.rank &&
+			    card->suit == hand->card.suit)
+				break;
+			i++;
+		}
+		if (i == deck->head) {
+			errno = EINVAL;
+			return -1;
+		}
+		Card *from = &deck->cards[ring_index(deck, i)];
+		Card *to = &deck->cards[ring_index(deck, top++)];
+		Card card = *from;
+		*from = *to;
+		*to = card;
+	}
+	deck->played = top;
+	return 0;
+}
+
+/*
+ * deck_reinsert - Put the oldest discards back under a deck.
+ * @deck: Pointer to a deck outside a continuous shuffler.
+ * @count: Number of discards to put back, at most the cards in the tray.
+ *
+ * The ring wraps the bottom of the deck round to the bottom of the discard
+ * tray, so the discards join the deck in the order they were discarded
+ * without a card moving. They leave the Hi-Lo count, as they can be dealt
+ * again. Rounds dealt once cards are reinserted cannot be replayed.
+ *
+ * Return: 0 on success, -1 on error with errno set.
+ */
+int deck_reinsert(Deck *deck, size_t count)
+{
+	if (deck == NULL || deck->cards == NULL || deck->csm != NULL ||
+	    count > deck->played - deck->discard) {
+		errno = EINVAL;
+		return -1;
+	}
+	count_up(deck);
+	for (size_t i = deck->discard; i < deck->discard + count; i++) {
+		size_t index = ring_index(deck, i);
+		if (!deck->burned[index])
+			deck->running -= hilo_tag(deck->cards[index].rank);
+		deck->burned[index] = 0;
+	}
+	deck->discard += count;
+	deck->tail += count;
+	if (deck->discard >= deck->capacity) {
+		// Start the next lap so every position stays below 2 * capacity
+		deck->discard -= deck->capacity;
+		deck->played -= deck->capacity;
+		deck->head -= deck->capacity;
+		deck->tail -= deck->capacity;
+		deck->counted -= deck->capacity;
+	}
+	return 0;
+}
+
+/*
+ * deck_partial_shuffle - Shuffle the discard tray into the back of a deck.
+ * @deck: Pointer to a deck outside a continuous shuffler.
+ * @depth: Cards at the bottom of the deck to shuffle once the discards are
+ *         under it, the whole deck if it holds fewer.
+ *
+ * Every discard is put back with deck_reinsert() and the bottom @depth cards
+ * are shuffled together, leaving the cards above them in order, as when a
+ * dealer shuffles the tray into the back of a shoe part way through it.
+ * Cards still in play stay out.
+ *
+ * Return: 0 on success, -1 on error with errno set.
+ */
+int deck_partial_shuffle(Deck *deck, size_t depth)
+{
+	if (deck == NULL || deck->cards == NULL || deck->csm != NULL) {
+		errno = EINVAL;
+		return -1;
+	}
+	deck_reinsert(deck, deck->played - deck->discard);
+	size_t size = tray_size(deck);
+	if (depth > size)
+		depth = size;
+	shuffle_below(deck, deck->tail + 1 - depth);
+	return 0;
+}
+
+/*
+ * deal - Deal a card from a deck to a hand.
+ * @deck: Pointer to the deck to deal from.
+ * @hand: Pointer to the pointer of the hand to deal to.
+ *
+ * Deals a card from the deck by incrementing the head and adding the card to the hand.
+ *
+ * Return: 0 on success, -1 on error with errno set.
+ */
+int deal(Deck *deck, Hand **hand)
+{
+	// Ensure deck exists
+	if (deck == NULL || deck->cards == NULL) {
+		errno = EINVAL;
+		return -1;
+	}
+	if (deck->head > deck->tail) {
+		errno = ENODATA;
+		return -1;
+	}
+	// Get card and increment deck head
+	struct card tmp_card = deck->cards[ring_index(deck, deck->head)];
+	deck->head += 1;
+	if (deck->head > deck->tail && deck->csm != NULL)
+		csm_refill(deck);
+	// Add card to hand
+	Hand *player_hand = malloc(sizeof(Hand));
+	if (player_hand == NULL) {
+		errno = ENOMEM;
+		return -1;
+	}
+	player_hand->card = tmp_card;
+	player_hand->next = *hand;
+	*hand = player_hand;
+	return 0;
+}
+
+/*
+ * deck_draw - Deal the top card of a deck without adding it to a hand.
+ * @deck: Pointer to the deck to deal from.
+ * @rank: Where to store the rank of the card.
+ * @suit: Where to store the suit of the card.
+ *
+ * For games that only need each card's rank and suit, this saves deal()'s
+ * allocation of a hand node.
+ *
+ * Return: 0 on success, -1 on error with errno set to EINVAL or ENODATA if
+ * the deck is empty.
+ */
+int deck_draw(Deck *deck, Rank *rank, Suit *suit)
+{
+	if (deck == NULL || deck->cards == NULL || rank == NULL ||
+	    suit == NULL) {
+		errno = EINVAL;
+		return -1;
+	}
+	if (deck->head > deck->tail) {
+		errno = ENODATA;
+		return -1;
+	}
+	const Card *card = &deck->cards[ring_index(deck, deck->head)];
+	*rank = card->rank;
+	*suit = card->suit;
+	deck->head++;
+	if (deck->head > deck->tail && deck->csm != NULL)
+		csm_refill(deck);
+	return 0;
+}
+
+/*
+ * deck_composition - Count the cards left in a deck.
+ * @deck: Pointer to the deck.
+ * @counts: Array of STANDARD_DECK_SIZE counts to fill, indexed like CardSet
+ *          bits: suit * 13 + rank - 1.
+ *
+ * Return: Number of cards left, or -1 on error with errno set.
+ */
+int deck_composition(const Deck *deck, unsigned *counts)
+{
+	if (deck == NULL || deck->cards == NULL || counts == NULL) {
+		errno = EINVAL;
+		return -1;
+	}
+	memset(counts, 0, STANDARD_DECK_SIZE * sizeof(*counts));
+	size_t size = tray_size(deck);
+	for (size_t i = deck->head; i < deck->head + size; i++) {
+		const Card *card = &deck->cards[ring_index(deck, i)];
+		counts[card->suit * 13 + card->rank - 1]++;
+	}
+	const struct csm *csm = deck->csm;
+	for (uint32_t i = 0; csm != NULL && i < csm->num_live; i++) {
+		for (uint32_t slot = csm->top[csm->live[i]]; slot != CSM_NONE;
+		     slot = csm->next[slot]) {
+			const Card *card = &csm->slots[slot];
+			counts[card->suit * 13 + card->rank - 1]++;
+		}
+	}
+	return (int)deck_size(deck);
+}
+
+/*
+ * deck_count - Hi-Lo count of the cards dealt from a deck.
+ * @deck: Pointer to the deck.
+ * @running: Where to store the running count, or NULL.
+ * @true_count: Where to store the running count per pack left, or NULL.
+ *
+ * The count covers every card dealt since the deck was generated, renewed
+ * or restacked, less burned cards and those deck_reinsert() put back. It
+ * is kept incrementally, each call only tags the cards
+ * dealt since the last one, so asking before every round costs a few cards'
+ * work rather than a pass over the shoe.
+ *
+ * Return: 0 on success, -1 on error with errno set.
+ */
+int deck_count(Deck *deck, int *running, double *true_count)
+{
+	if (deck == NULL || deck->cards == NULL) {
+		errno = EINVAL;
+		return -1;
+	}
+	count_up(deck);
+	if (running != NULL)
+		*running = deck->running;
+	if (true_count != NULL) {
+		size_t left = deck_size(deck);
+		*true_count = left == 0 ? 0.0 : deck->running /
+				((double)left / STANDARD_DECK_SIZE);
+	}
+	return 0;
+}
+
+/*
+ * count_bin - Bin of a true count.
+ * @true_count: Hi-Lo true count.
+ *
+ * Counts are rounded to the nearest integer, and those beyond COUNT_MIN_TC
+ * or COUNT_MAX_TC join the end bins, so every tally kept by true count
+ * shares the same bins.
+ *
+ * Return: Index from 0 to COUNT_BINS - 1, bin i holding true count
+ * COUNT_MIN_TC + i.
+ */
+int count_bin(double true_count)
+{
+	long count = lround(true_count);
+	if (count < COUNT_MIN_TC)
+		count = COUNT_MIN_TC;
+	if (count > COUNT_MAX_TC)
+		count = COUNT_MAX_TC;
+	return (int)(count - COUNT_MIN_TC);
+}
+
+/*
+ * cardset_select - Find a card of a set by its position.
+ * @set: Set to search.
+ * @index: Position of the card, counting from 0 in bit order.
+ *
+ * With BMI2 this is a single pdep and a trailing zero count. Otherwise whole
+ * bytes are skipped by popcount before the remaining bits are cleared one at
+ * a time.
+ *
+ * Return: Bit of the card, or -1 if @set holds @index or fewer cards.
+ */
+int cardset_select(CardSet set, int index)
+{
+	if (index < 0 || index >= cardset_size(set))
+		return -1;
+#ifdef __BMI2__
+	return __builtin_ctzll(_pdep_u64((uint64_t)1 << index, set));
+#else
+	int base = 0;
+	for (;;) {
+		int count = __builtin_popcountll(set & 0xFF);
+		if (index < count)
+			break;
+		index -= count;
+		set >>= 8;
+		base += 8;
+	}
+	while (index-- > 0)
+		set &= set - 1;
+	return base + __builtin_ctzll(set);
+#endif
 }
 
 /*
- * deck_rep - Write a human-readable string for a deck of cards.
- * @deck: Deck to print.
- *
- * Displays cards in deck with up to 26 cards per line.
+ * cardset_draw - Remove a uniformly random card from a set.
+ * @set: Set to draw from.
+ * @rng: Generator to draw with.
+ * @rank: Where to store the rank of the card drawn.
+ * @suit: Where to store the suit of the card drawn.
  *
- * Return: 0 on success, -1 on error with errno set.
+ * Return: 0 on success, -1 on error with errno set to EINVAL or ENODATA if
+ * @set is empty.
  */
-int deck_rep(Deck *deck)
+int cardset_draw(CardSet *set, Rng *rng, Rank *rank, Suit *suit)
 {
-	if (deck == NULL) {
+	if (set == NULL || rng == NULL || rank == NULL || suit == NULL) {
 		errno = EINVAL;
 		return -1;
 	}
-	char buffer[CARD_STR_LEN];
-	size_t buf_size = sizeof(buffer);
-	size_t index = deck->head;
-	size_t length = 0;
-	while (index <= deck->tail) {
-		card_rep(buffer, buf_size, &deck->cards[index]);
-		if (length >= DECK_REP_LEN) {
-			if (printf("\n") < 0) {
-				errno = EIO;
-				return -1;
-			}
-			length = 0;
-		}
-		if (printf("%s ", buffer) < 0) {
-			errno = EIO;
-			return -1;
-		}
-		index++;
-		length++;
+	if (*set == CARDSET_EMPTY) {
+		errno = ENODATA;
+		return -1;
 	}
-	printf("\n");
+	int bit = cardset_select(*set,
+		(int)rng_bounded(rng, (uint32_t)cardset_size(*set)));
+	*set &= ~((CardSet)1 << bit);
+	*rank = (Rank)(bit % 13 + 1);
+	*suit = (Suit)(bit / 13);
 	return 0;
 }
 
 /*
- * hand_rep - Write a human-readable string for a hand of cards.
- * @deck: Hand to print.
- *
- * Displays cards in a hand, with up to 7 cards per line.
+ * cardset_add - Add a card to a set, refusing duplicates.
+ * @set: Set to add to.
+ * @card: Card to add.
  *
- * Return: 0 on success, -1 on error with errno set.
+ * Return: 0 on success, -1 with errno set to EINVAL if @card is already in
+ * @set.
  */
-int hand_rep(Hand *hand)
+static int cardset_add(CardSet *set, const Card *card)
 {
-	if (hand == NULL) {
+	CardSet bit = cardset_card(card->rank, card->suit);
+	if (*set & bit) {
 		errno = EINVAL;
 		return -1;
 	}
-	char buffer[CARD_STR_LEN];
-	size_t buf_size = sizeof(buffer);
-	size_t length = 0;
-	for (Hand *ptr = hand; ptr != NULL; ptr = ptr->next) {
-		card_rep(buffer, buf_size, &ptr->card);
-		if (length >= HAND_REP_LEN) {
-			if (printf("\n") < 0) {
-				errno = EIO;
-				return -1;
-			}
-			length = 0;
-		}
-		if (printf("%s ", buffer) < 0) {
-			errno = EIO;
-			return -1;
-		}
-		length++;
-	}
-	printf("\n");
+	*set |= bit;
 	return 0;
 }
 
 /*
- * deck_gen - Generate a deck (well actually a shoe) of playing cards.
- * @packs: Number of standard 52-card packs to include.
+ * deck_cardset - Convert the cards left in a deck to a set.
+ * @deck: Pointer to the deck.
+ * @set: Where to store the set.
  *
- * Allocates and initializes a deck with the specified number of packs,
- * each in USPCC new deck order.
+ * The order of the deck is lost. Decks holding a card twice, as shoes of
+ * several packs do, cannot be represented. Cards on the shelves of a
+ * continuous shuffler are included.
  *
- * Return: Pointer to the new deck, or NULL on error with errno set.
+ * Return: 0 on success, -1 on error with errno set.
  */
-Deck *deck_gen(int packs)
+int deck_cardset(const Deck *deck, CardSet *set)
 {
-	if (packs < 1) {
+	if (deck == NULL || deck->cards == NULL || set == NULL) {
 		errno = EINVAL;
-		return NULL;
-	}
-	size_t num_cards = STANDARD_DECK_SIZE * packs;
-	struct card *cards = malloc(num_cards * sizeof(struct card));
-	if (cards == NULL) {
-		errno = ENOMEM;
-		return NULL;
+		return -1;
 	}
-	Deck *deck = malloc(sizeof(Deck));
-	if (deck == NULL) {
-		free(cards);
-		errno = ENOMEM;
-		return NULL;
+	CardSet cards = CARDSET_EMPTY;
+	for (size_t i = deck->head; i < deck->head + tray_size(deck); i++) {
+		if (cardset_add(&cards, &deck->cards[ring_index(deck, i)]) < 0)
+			return -1;
 	}
-	size_t index = 0;
-	for (size_t i = 0; i < (size_t)packs; i++) {
-		for (Suit suit = SPADES; suit <= HEARTS; suit++) {
-			for (Rank rank = ACE; rank <= KING; rank++) {
-				cards[index].rank = rank;
-				cards[index].suit = suit;
-				index++;
-			}
+	const struct csm *csm = deck->csm;
+	for (uint32_t i = 0; csm != NULL && i < csm->num_live; i++) {
+		for (uint32_t slot = csm->top[csm->live[i]]; slot != CSM_NONE;
+		     slot = csm->next[slot]) {
+			if (cardset_add(&cards, &csm->slots[slot]) < 0)
+				return -1;
 		}
 	}
-	deck->cards = cards;
-	deck->head = 0;
-	deck->tail = num_cards - 1;
-	return deck;
+	*set = cards;
+	return 0;
 }
 
 /*
- * deck_size - Calculate the number of playing cards in a deck.
- * @deck: Pointer to the deck.
+ * hand_cardset - Convert the cards of a hand to a set.
+ * @hand: Pointer to the hand, NULL for an empty hand.
+ * @set: Where to store the set.
  *
- * Return: Number of cards in the deck, or maximum size_t value on error with
- * errno set.
+ * Return: 0 on success, -1 on error with errno set.
  */
-size_t deck_size(const Deck *deck)
+int hand_cardset(const Hand *hand, CardSet *set)
 {
-	if (deck == NULL || deck->cards == NULL) {
+	if (set == NULL) {
 		errno = EINVAL;
-		return (size_t)-1; // Maximum value to represent error
+		return -1;
 	}
-	if (deck->head > deck->tail)
-		return 0; // Deck is empty
-	size_t size = deck->tail - deck->head + 1;
-	return size;
+	CardSet cards = CARDSET_EMPTY;
+	for (; hand != NULL; hand = hand->next) {
+		if (cardset_add(&cards, &hand->card) < 0)
+			return -1;
+	}
+	*set = cards;
+	return 0;
 }
 
-/**
- * deck_shuffle - Shuffle a deck of playing cards.
- * @deck: Pointer to the deck to shuffle.
+/*
+ * cardset_deck - Build a deck from a set.
+ * @set: Cards of the deck.
  *
- * Shuffles the cards in the deck using the Fisher-Yates algorithm.
+ * The cards are stacked in bit order, so the ace of spades is on top if
+ * present. Shuffle with deck_shuffle() as needed.
  *
- * Return: 0 on success, -1 on error with errno set.
+ * Return: Pointer to the new deck, or NULL on error with errno set to ENOMEM
+ * or ENODATA if @set is empty.
  */
-int deck_shuffle(Deck *deck)
+Deck *cardset_deck(CardSet set)
 {
-	if (deck == NULL || deck->cards == NULL) {
-		errno = EINVAL;
-		return -1;
+	set &= CARDSET_FULL;
+	if (set == CARDSET_EMPTY) {
+		errno = ENODATA;
+		return NULL;
 	}
-	for (size_t i = deck->tail; i > deck->head; i--) {
-		size_t random_card = rand() % (i + 1);
-		struct card tmp_card = deck->cards[i];
-		deck->cards[i] = deck->cards[random_card];
-		deck->cards[random_card] = tmp_card;
+	Deck *deck = deck_alloc((size_t)cardset_size(set), 0, random_seed(), 0);
+	if (deck == NULL)
+		return NULL;
+	for (size_t i = 0; set != CARDSET_EMPTY; i++, set &= set - 1) {
+		int bit = __builtin_ctzll(set);
+		deck->cards[i].rank = (Rank)(bit % 13 + 1);
+		deck->cards[i].suit = (Suit)(bit / 13);
 	}
-	return 0;
+	return deck;
 }
 
 /*
- * deal - Deal a card from a deck to a hand.
- * @deck: Pointer to the deck to deal from.
- * @hand: Pointer to the pointer of the hand to deal to.
+ * cardset_hand - Build a hand from a set.
+ * @set: Cards of the hand.
  *
- * Deals a card from the deck by incrementing the head and adding the card to the hand.
+ * The cards are added in bit order, so the last card of the set heads the
+ * hand as if it were dealt last. Free the hand with unload_hand().
  *
- * Return: 0 on success, -1 on error with errno set.
+ * Return: Pointer to the new hand, or NULL for an empty set or on error with
+ * errno set.
  */
-int deal(Deck *deck, Hand **hand)
+Hand *cardset_hand(CardSet set)
 {
-	// Ensure deck exists
-	if (deck == NULL || deck->cards == NULL) {
-		errno = EINVAL;
-		return -1;
-	}
-	if (deck->head > deck->tail) {
-		errno = ENODATA;
-		return -1;
-	}
-	// Get card and increment deck head
-	struct card tmp_card = deck->cards[deck->head];
-	deck->head += 1;
-	// Add card to hand
-	Hand *player_hand = malloc(sizeof(Hand));
-	if (player_hand == NULL) {
-		errno = ENOMEM;
-		return -1;
+	Hand *hand = NULL;
+	errno = 0;
+	for (set &= CARDSET_FULL; set != CARDSET_EMPTY; set &= set - 1) {
+		Hand *node = malloc(sizeof(Hand));
+		if (node == NULL) {
+			unload_hand(hand);
+			errno = ENOMEM;
+			return NULL;
+		}
+		int bit = __builtin_ctzll(set);
+		node->card.rank = (Rank)(bit % 13 + 1);
+		node->card.suit = (Suit)(bit / 13);
+		node->next = hand;
+		hand = node;
 	}
-	player_hand->card = tmp_card;
-	player_hand->next = *hand;
-	*hand = player_hand;
-	return 0;
+	return hand;
 }
 
 /*
@@ -338,11 +2383,10 @@ int blackjack_score(Hand *hand)
 			score += card_score;
 		}
 
-		if (score > 21 && aces > 0) {
-			for (int i = aces; i > 0; i--) {
-				score -= 10;
-				aces--;
-			}
+		// Count aces as 1 one at a time, only as many as needed
+		while (score > 21 && aces > 0) {
+			score -= 10;
+			aces--;
 		}
 
 		if (score > 21) {
@@ -356,6 +2400,26 @@ int blackjack_score(Hand *hand)
 	}
 }
 
+/*
+ * blackjack_net - Player's winnings from a round of blackjack.
+ * @player_score: Final score of the player (see blackjack_score()).
+ * @dealer_score: Final score of the dealer (see blackjack_score()).
+ *
+ * A player who busts loses before the dealer plays, so a bust loses even
+ * when the dealer busts too, although both score 0.
+ *
+ * Return: Winnings in half bets: 3 for a blackjack, 2 for a win, 0 for a
+ * push and -2 for a loss.
+ */
+int blackjack_net(int player_score, int dealer_score)
+{
+	if (player_score == 0 || player_score < dealer_score)
+		return -2;
+	if (player_score > dealer_score)
+		return player_score == 22 ? 3 : 2;
+	return 0;
+}
+
 /*
  * blackjack_value - Value of a card in a game of a blackjack.
  * @card: Card to score.
@@ -391,14 +2455,28 @@ int blackjack_value(Card *card)
 }
 
 /*
- * blackjack_turn - A players turn in a game of blackjack.
+ * record_decision - Append a player decision to a round record.
+ * @record: Record to append to, may be NULL.
+ * @decision: 'h' to hit or 's' to stick.
+ */
+static void record_decision(BlackjackRecord *record, char decision)
+{
+	if (record == NULL || record->num_decisions >= BLACKJACK_MAX_DECISIONS)
+		return;
+	record->decisions[record->num_decisions++] = decision;
+}
+
+/*
+ * blackjack_turn_record - A players turn in a game of blackjack, recorded.
  * @deck: Pointer to the game deck.
  * @hand: Pointer to the players hand.
  * @dealer: If the player is the dealer or not.
+ * @record: Record to append the player's decisions to, may be NULL.
  *
  * Return: Players score when they stick, -1 on error with errno set.
  */
-int blackjack_turn(Deck *deck, Hand **hand, _Bool dealer)
+int blackjack_turn_record(Deck *deck, Hand **hand, _Bool dealer,
+			  BlackjackRecord *record)
 {
 	if (deck == NULL) {
 		errno = EINVAL;
@@ -445,9 +2523,11 @@ int blackjack_turn(Deck *deck, Hand **hand, _Bool dealer)
 			fgets(buffer, 3, stdin);
 			printf("\n");
 			if (strcmp(buffer, "h\n") == 0) {
+				record_decision(record, 'h');
 				deal(deck, hand);
 				score = blackjack_score(*hand);
 			} else if (strcmp(buffer, "s\n") == 0) {
+				record_decision(record, 's');
 				stick = 1;
 			} else {
 				printf("H or S required\n");
@@ -464,6 +2544,216 @@ int blackjack_turn(Deck *deck, Hand **hand, _Bool dealer)
 	return score;
 }
 
+/*
+ * blackjack_turn - A players turn in a game of blackjack.
+ * @deck: Pointer to the game deck.
+ * @hand: Pointer to the players hand.
+ * @dealer: If the player is the dealer or not.
+ *
+ * Return: Players score when they stick, -1 on error with errno set.
+ */
+int blackjack_turn(Deck *deck, Hand **hand, _Bool dealer)
+{
+	return blackjack_turn_record(deck, hand, dealer, NULL);
+}
+
+/*
+ * hand_total - Total of a blackjack hand and whether it is soft.
+ * @hand: Hand to total.
+ * @soft: Set if an ace is being counted as 11.
+ *
+ * Return: Total of the hand counting aces high where that does not bust.
+ */
+static int hand_total(Hand *hand, _Bool *soft)
+{
+	int total = 0;
+	_Bool ace = 0;
+	for (Hand *ptr = hand; ptr != NULL; ptr = ptr->next) {
+		int value = blackjack_value(&ptr->card);
+		if (value == 11) {
+			value = 1;
+			ace = 1;
+		}
+		total += value;
+	}
+	*soft = ace && total + 10 <= 21;
+	return *soft ? total + 10 : total;
+}
+
+/*
+ * blackjack_strategy - Basic strategy decision for a player's hand.
+ * @total: Total of the player's hand, counting a soft ace as 11.
+ * @soft: If the hand is soft.
+ * @upcard: blackjack_value() of the dealer's first card (2 to 11).
+ *
+ * Return: 'h' to hit or 's' to stick.
+ */
+char blackjack_strategy(int total, _Bool soft, int upcard)
+{
+	if (soft) {
+		if (total >= 19 || (total == 18 && upcard < 9))
+			return 's';
+		return 'h';
+	}
+	if (total >= 17)
+		return 's';
+	if (total >= 13)
+		return upcard <= 6 ? 's' : 'h';
+	if (total == 12)
+		return (upcard >= 4 && upcard <= 6) ? 's' : 'h';
+	return 'h';
+}
+
+/*
+ * play_round - Deal and play a round of blackjack headlessly.
+ * @deck: Pointer to the deck to deal from.
+ * @record: Round record, see blackjack_round() and blackjack_auto().
+ * @automatic: Decide with blackjack_strategy() instead of reading @record.
+ *
+ * Return: 0 on success, -1 on error with errno set.
+ */
+static int play_round(Deck *deck, BlackjackRecord *record, _Bool automatic)
+{
+	if (deck == NULL || deck->cards == NULL || record == NULL) {
+		errno = EINVAL;
+		return -1;
+	}
+	record->seed = deck->seed;
+	record->stream = deck->stream;
+	record->shuffles = deck->shuffles;
+	record->packs = deck->packs;
+	record->offset = deck->head;
+	if (automatic)
+		record->num_decisions = 0;
+
+	Hand *dealer = NULL;
+	Hand *player = NULL;
+	int ret = -1;
+	for (size_t i = 0; i < BLACKJACK_INITIAL_DEAL; i++) {
+		if (deal(deck, &dealer) < 0 || deal(deck, &player) < 0)
+			goto out;
+	}
+	int upcard = blackjack_value(&dealer->next->card); // First card dealt
+	int player_score = blackjack_score(player);
+	for (size_t i = 0; player_score > 0; i++) {
+		char decision;
+		if (automatic) {
+			_Bool soft;
+			int total = hand_total(player, &soft);
+			decision = player_score == 22 ? 's' :
+				   blackjack_strategy(total, soft, upcard);
+			record_decision(record, decision);
+		} else if (i < record->num_decisions) {
+			decision = record->decisions[i];
+		} else {
+			errno = EINVAL; // Ran out of decisions mid-turn
+			goto out;
+		}
+		if (decision == 's')
+			break;
+		if (decision != 'h') {
+			errno = EINVAL;
+			goto out;
+		}
+		if (deal(deck, &player) < 0)
+			goto out;
+		player_score = blackjack_score(player);
+	}
+	int dealer_score = blackjack_score(dealer);
+	_Bool soft;
+	while (dealer_score > 0 &&
+	       (dealer_score < 17 ||
+		(record->hit_soft_17 && dealer_score == 17 &&
+		 hand_total(dealer, &soft) == 17 && soft))) {
+		if (deal(deck, &dealer) < 0)
+			goto out;
+		dealer_score = blackjack_score(dealer);
+	}
+	record->player_score = player_score;
+	record->dealer_score = dealer_score;
+	deck_discard(deck, NULL); // Finished rounds go to the tray as dealt
+	ret = 0;
+out:
+	unload_hand(dealer);
+	unload_hand(player);
+	return ret;
+}
+
+/*
+ * blackjack_round - Play a round of blackjack without any input or output.
+ * @deck: Pointer to the deck to deal from.
+ * @record: Decisions for the player to follow, scores are written back.
+ *
+ * Deals the round exactly as blackjack() does, taking the player's decisions
+ * from @record instead of stdin, then plays the dealer's hand, hitting soft
+ * 17 if @record->hit_soft_17 is set. The seed, stream, shuffles, packs and
+ * offset of @deck are stored in @record.
+ *
+ * Return: 0 on success, -1 on error with errno set.
+ */
+int blackjack_round(Deck *deck, BlackjackRecord *record)
+{
+	return play_round(deck, record, 0);
+}
+
+/*
+ * blackjack_auto - Play a round of blackjack using basic strategy.
+ * @deck: Pointer to the deck to deal from.
+ * @record: Record to fill with the round's decisions and scores.
+ *
+ * Plays like blackjack_round(), deciding with blackjack_strategy() against the
+ * dealer's first card. The filled @record can be passed to blackjack_replay().
+ *
+ * Return: 0 on success, -1 on error with errno set.
+ */
+int blackjack_auto(Deck *deck, BlackjackRecord *record)
+{
+	return play_round(deck, record, 1);
+}
+
+/*
+ * blackjack_replay - Replay a recorded round and check it plays out the same.
+ * @record: Round to replay.
+ *
+ * Regenerates the shoe from the recorded seed, stream and shuffles with
+ * deck_replay_shoe(), skips the cards dealt before the round and replays
+ * the recorded decisions.
+ *
+ * Return: 0 if the replay reproduces the recorded scores, -1 with errno set
+ * to EBADMSG if it does not, or -1 on any other error with errno set.
+ */
+int blackjack_replay(const BlackjackRecord *record)
+{
+	if (record == NULL) {
+		errno = EINVAL;
+		return -1;
+	}
+	Deck *shoe = deck_replay_shoe(record->packs, record->seed,
+				      record->stream, record->shuffles);
+	if (shoe == NULL) {
+		return -1;
+	}
+	if (record->offset > deck_size(shoe)) {
+		unload_deck(shoe);
+		errno = EINVAL;
+		return -1;
+	}
+	shoe->head += record->offset;
+	shoe->played = shoe->head; // Cards skipped count as discarded
+	BlackjackRecord replay = *record;
+	int ret = blackjack_round(shoe, &replay);
+	unload_deck(shoe);
+	if (ret < 0) {
+		return -1;
+	}
+	if (replay.player_score != record->player_score ||
+	    replay.dealer_score != record->dealer_score) {
+		errno = EBADMSG;
+		return -1;
+	}
+	return 0;
+}
+
 /*
  * unload_deck - Free memory of cards in the deck and the deck itself.
  * @deck: Pointer to the deck to free.
@@ -480,6 +2770,8 @@ int unload_deck(Deck *deck)
 		free(deck->cards);
 		deck->cards = NULL;
 	}
+	free(deck->burned);
+	csm_free(deck);
 	free(deck);
 	return 0;
 }
@@ -497,6 +2789,10 @@ int blackjack(void)
 		unload_deck(shoe);
 		return -1;
 	}
+	BlackjackRecord record = { 0 };
+	record.packs = shoe->packs;
+	deck_get_seed(shoe, &record.seed, &record.stream);
+	record.shuffles = shoe->shuffles;
 	Hand *dealer = NULL;
 	Hand *player = NULL;
 	// Deal hand to dealer and player
@@ -519,10 +2815,22 @@ int blackjack(void)
 	printf("Dealer: ");
 	hand_rep(dealer);
 	printf("\n");
-	int player_score = blackjack_turn(shoe, &player, 0);
-	int dealer_score = blackjack_turn(shoe, &dealer, 1);
+	int player_score = blackjack_turn_record(shoe, &player, 0, &record);
+	// A player who busts has lost, so the dealer keeps the hand as dealt
+	int dealer_score = player_score > 0 ? blackjack_turn(shoe, &dealer, 1) :
+			   blackjack_score(dealer);
+	if (player_score < 0 || dealer_score < 0) {
+		perror("blackjack_turn");
+		unload_deck(shoe);
+		unload_hand(dealer);
+		unload_hand(player);
+		return -1;
+	}
+	record.player_score = player_score;
+	record.dealer_score = dealer_score;
 
-	if (player_score > dealer_score) {
+	int net = blackjack_net(player_score, dealer_score);
+	if (net > 0) {
 		printf("Player wins with ");
 		if (player_score < 22) {
 			printf("%d!\n", player_score);
@@ -530,7 +2838,7 @@ int blackjack(void)
 			printf("Blackjack!\n");
 		}
 	}
-	else if (dealer_score > player_score) {
+	else if (net < 0) {
 		printf("Dealer wins with ");
 		if (dealer_score < 22) {
 			printf("%d!\n", dealer_score);
@@ -540,6 +2848,9 @@ int blackjack(void)
 	} else {
 		printf("Draw!\n");
 	}
+	printf("Round: seed %" PRIu64 " stream %" PRIu64 " decisions %.*s\n",
+	       record.seed, record.stream, (int)record.num_decisions,
+	       record.decisions);
 
 	// Free memory
 	if (unload_deck(shoe) < 0) {
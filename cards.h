@@ -2,12 +2,17 @@
 #define CARDS_H
 
 #include <stddef.h> // provides size_t
+#include <stdint.h> // provides uint64_t
 
 #define CARD_STR_LEN 4 // Max length of string to represent cards
 #define STANDARD_DECK_SIZE 52
 #define DECK_REP_LEN 13 // Limit cards per line when printing decks
 #define HAND_REP_LEN 7 // Limit cards per line when printing hands
 #define BLACKJACK_INITIAL_DEAL 2
+#define BLACKJACK_MAX_DECISIONS 32 // Enough hits to reach 21 with 8 packs
+#define COUNT_MIN_TC -10 // Lowest true count binned, lower counts join it
+#define COUNT_MAX_TC 10 // Highest true count binned, higher counts join it
+#define COUNT_BINS (COUNT_MAX_TC - COUNT_MIN_TC + 1)
 
 /* The ranks of playing card. */
 typedef enum rank {
@@ -34,6 +39,67 @@ typedef enum suit {
 	HEARTS /* The heart suit (♥) */
 } Suit;
 
+/* The steps of a casino shuffle procedure, see deck_procedure(). */
+typedef enum shuffle_op {
+	SHUFFLE_RIFFLE, /* GSR riffle, cards drop in proportion to each half */
+	SHUFFLE_STRIP, /* Strip packets averaging size cards into a new pile */
+	SHUFFLE_BOX, /* Split into size packets and stack them in reverse */
+	SHUFFLE_PLUG, /* Plug the bottom size cards in at a random depth */
+	SHUFFLE_CUT /* Cut at a binomial point */
+} ShuffleOp;
+
+/*
+ * struct shuffle_step - One step of a shuffle procedure.
+ * @op: What the step does.
+ * @times: Number of times to repeat it.
+ * @size: Mean packet of a strip, packets of a box, or cards plugged.
+ *        Unused by riffles and cuts.
+ */
+typedef struct shuffle_step {
+	ShuffleOp op;
+	unsigned times;
+	unsigned size;
+} ShuffleStep;
+
+/*
+ * struct rng - A PCG32 pseudo-random number generator.
+ * @state: Current generator state.
+ * @inc: Stream increment, always odd.
+ *
+ * Generators seeded with the same seed and stream produce the same sequence on
+ * every platform, which lets shoes be regenerated exactly.
+ */
+typedef struct rng {
+	uint64_t state;
+	uint64_t inc;
+} Rng;
+
+/*
+ * struct blackjack_record - Everything needed to replay a round of blackjack.
+ * @seed: Seed of the shoe the round was dealt from.
+ * @stream: Stream id of the shoe the round was dealt from.
+ * @shuffles: Shuffles of the shoe since it was seeded, see deck_replay_shoe().
+ * @packs: Number of packs in the shoe.
+ * @offset: Cards dealt from the shoe before the round started.
+ * @hit_soft_17: If the dealer hits a soft 17 (H17) rather than sticking.
+ * @num_decisions: Number of player decisions recorded.
+ * @decisions: Player decisions in order, 'h' to hit and 's' to stick.
+ * @player_score: Final score of the player (see blackjack_score()).
+ * @dealer_score: Final score of the dealer (see blackjack_score()).
+ */
+typedef struct blackjack_record {
+	uint64_t seed;
+	uint64_t stream;
+	size_t shuffles;
+	int packs;
+	size_t offset;
+	_Bool hit_soft_17;
+	size_t num_decisions;
+	char decisions[BLACKJACK_MAX_DECISIONS];
+	int player_score;
+	int dealer_score;
+} BlackjackRecord;
+
 /* A playing card */
 typedef struct card Card;
 /* A deck containing playing cards */
@@ -45,13 +111,54 @@ typedef struct hand Hand;
 int card_rep(char *buffer, size_t buf_size, const Card *card);
 int deck_rep(Deck *deck);
 int hand_rep(Hand *hand);
+void rng_seed(Rng *rng, uint64_t seed, uint64_t stream);
+uint32_t rng_next(Rng *rng);
+uint32_t rng_bounded(Rng *rng, uint32_t bound);
 Deck *deck_gen(int packs);
+Deck *deck_gen_seeded(int packs, uint64_t seed, uint64_t stream);
+int deck_renew(Deck *deck);
+Deck *deck_parse(const char *str, size_t len);
+int deck_load(const char *path, Deck ***shoes, size_t *count);
+int deck_seed(Deck *deck, uint64_t seed, uint64_t stream);
+int deck_get_seed(const Deck *deck, uint64_t *seed, uint64_t *stream);
+Deck *deck_replay(int packs, uint64_t seed, uint64_t stream);
+Deck *deck_replay_shoe(int packs, uint64_t seed, uint64_t stream,
+		       size_t shuffles);
+int file_write_atomic(const char *path, const void *data, size_t size);
+int table_write(const char *path, const char *magic, uint32_t version,
+		const void *data, size_t size);
+const void *table_map(const char *path, const char *magic, uint32_t version,
+		      size_t *size);
+int table_unmap(const void *data, size_t size);
+int deck_snapshot(const char *path, const Deck *deck, Hand *const *hands,
+		  size_t num_hands, const int64_t *counts, size_t num_counts);
+Deck *deck_restore(const char *path, Hand **hands, size_t *num_hands,
+		   int64_t *counts, size_t *num_counts);
 size_t deck_size(const Deck *deck);
 int deck_shuffle(Deck *deck);
+int deck_restack(Deck *deck);
+int deck_procedure(Deck *deck, const ShuffleStep *steps, size_t num_steps);
+int deck_csm(Deck *deck, unsigned shelves);
+int deck_csm_return(Deck *deck);
+int deck_burn(Deck *deck, size_t count);
+int deck_discard(Deck *deck, const Hand *hand);
+int deck_reinsert(Deck *deck, size_t count);
+int deck_partial_shuffle(Deck *deck, size_t depth);
 int deal(Deck *deck, Hand **hand);
+int deck_draw(Deck *deck, Rank *rank, Suit *suit);
+int deck_composition(const Deck *deck, unsigned *counts);
+int deck_count(Deck *deck, int *running, double *true_count);
+int count_bin(double true_count);
 int blackjack_value(Card *card);
 int blackjack_score(Hand *hand);
+int blackjack_net(int player_score, int dealer_score);
 int blackjack_turn(Deck *deck, Hand **hand, _Bool dealer);
+int blackjack_turn_record(Deck *deck, Hand **hand, _Bool dealer,
+			  BlackjackRecord *record);
+char blackjack_strategy(int total, _Bool soft, int upcard);
+int blackjack_round(Deck *deck, BlackjackRecord *record);
+int blackjack_auto(Deck *deck, BlackjackRecord *record);
+int blackjack_replay(const BlackjackRecord *record);
 int blackjack(void);
 int unload_deck(Deck *deck);
 int unload_hand(Hand *hand);
@@ -0,0 +1,123 @@
+#ifndef CARDSET_H
+#define CARDSET_H
+
+#include <stdint.h> // provides uint64_t
+#include "cards.h"
+
+#define CARDSET_EMPTY ((CardSet)0)
+#define CARDSET_FULL ((CardSet)0xFFFFFFFFFFFFFULL) // All 52 cards of a pack
+#define CARDSET_SUIT_MASK ((CardSet)0x1FFF) // Ace to king of one suit
+#define CARDSET_RANK_MASK ((CardSet)0x8004002001ULL) // Aces of each suit
+
+/*
+ * A set of distinct playing cards from one pack, one bit per card. The card of
+ * rank r and suit s is bit s * 13 + (r - 1), so each suit fills 13
+ * consecutive bits from ace to king.
+ */
+typedef uint64_t CardSet;
+
+/*
+ * cardset_card - Set holding a single card.
+ * @rank: Rank of the card (ACE to KING).
+ * @suit: Suit of the card (SPADES to HEARTS).
+ *
+ * Return: Set with only the card's bit set.
+ */
+static inline CardSet cardset_card(Rank rank, Suit suit)
+{
+	return (CardSet)1 << ((unsigned)suit * 13 + (unsigned)rank - 1);
+}
+
+/*
+ * cardset_has - Check if a set holds a card.
+ * @set: Set to check.
+ * @rank: Rank of the card.
+ * @suit: Suit of the card.
+ *
+ * Return: 1 if the card is in @set, otherwise 0.
+ */
+static inline _Bool cardset_has(CardSet set, Rank rank, Suit suit)
+{
+	return (set & cardset_card(rank, suit)) != 0;
+}
+
+/*
+ * cardset_union - Cards in either of two sets.
+ * @a: First set.
+ * @b: Second set.
+ *
+ * Return: Union of @a and @b.
+ */
+static inline CardSet cardset_union(CardSet a, CardSet b)
+{
+	return a | b;
+}
+
+/*
+ * cardset_intersect - Cards in both of two sets.
+ * @a: First set.
+ * @b: Second set.
+ *
+ * Return: Intersection of @a and @b.
+ */
+static inline CardSet cardset_intersect(CardSet a, CardSet b)
+{
+	return a & b;
+}
+
+/*
+ * cardset_remove - Cards of one set not in another.
+ * @set: Set to remove from.
+ * @removed: Cards to remove.
+ *
+ * Return: @set without the cards of @removed.
+ */
+static inline CardSet cardset_remove(CardSet set, CardSet removed)
+{
+	return set & ~removed;
+}
+
+/*
+ * cardset_size - Count the cards in a set.
+ * @set: Set to count.
+ *
+ * Return: Number of cards in @set.
+ */
+static inline int cardset_size(CardSet set)
+{
+	return __builtin_popcountll(set);
+}
+
+/*
+ * cardset_rank - Cards of one rank in a set.
+ * @set: Set to query.
+ * @rank: Rank to select.
+ *
+ * Return: The cards of @set with rank @rank.
+ */
+static inline CardSet cardset_rank(CardSet set, Rank rank)
+{
+	return set & (CARDSET_RANK_MASK << ((unsigned)rank - 1));
+}
+
+/*
+ * cardset_suit - Ranks held in one suit of a set.
+ * @set: Set to query.
+ * @suit: Suit to select.
+ *
+ * Return: 13-bit mask with bit r - 1 set if @set holds rank r of @suit.
+ */
+static inline unsigned cardset_suit(CardSet set, Suit suit)
+{
+	return (unsigned)((set >> ((unsigned)suit * 13)) & CARDSET_SUIT_MASK);
+}
+
+/* Function prototypes. */
+int cardset_select(CardSet set, int index);
+int cardset_draw(CardSet *set, Rng *rng, Rank *rank, Suit *suit);
+int deck_cardset(const Deck *deck, CardSet *set);
+int hand_cardset(const Hand *hand, CardSet *set);
+Deck *cardset_deck(CardSet set);
+Hand *cardset_hand(CardSet set);
+
+#endif // CARDSET_H
@@ -0,0 +1,371 @@
+/*
+ * equity.c - Texas Hold'em equity by enumeration or sampling.
+ */
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include "equity.h"
+#include "poker.h"
+#include "pool.h"
+
+#define HOLE_CARDS 2
+#define SAMPLE_BLOCK 4096 // Sampled boards handed to a thread at a time
+
+/*
+ * struct equity_tally - Running counts of an equity calculation.
+ * @boards: Boards evaluated.
+ * @wins: Outright wins of each player.
+ * @ties: Split pots of each player.
+ * @shares: Pot shares of each player in 1/EQUITY_SHARE_UNIT parts.
+ */
+struct equity_tally {
+	uint64_t boards;
+	uint64_t wins[EQUITY_MAX_PLAYERS];
+	uint64_t ties[EQUITY_MAX_PLAYERS];
+	uint64_t shares[EQUITY_MAX_PLAYERS];
+};
+
+/*
+ * struct equity_job - Work shared by the threads of an equity calculation.
+ * @holes: Hole cards of each player.
+ * @hole_keys: poker_key() of each player's hole cards.
+ * @num_players: Number of players.
+ * @boards: Boards to score.
+ * @total: Merged counts of every thread.
+ */
+struct equity_job {
+	const CardSet *holes;
+	PokerKey hole_keys[EQUITY_MAX_PLAYERS];
+	size_t num_players;
+	EquityBoards boards;
+	struct equity_tally total;
+};
+
+/*
+ * struct equity_local - State of one thread of an equity calculation.
+ * @job: Job the thread works on.
+ * @tally: Counts of the boards the thread has scored.
+ */
+struct equity_local {
+	const struct equity_job *job;
+	struct equity_tally tally;
+};
+
+/*
+ * count_boards - Count the ways to complete a board.
+ * @cards: Cards that can still come.
+ * @to_come: Board cards still to come.
+ *
+ * Return: Binomial coefficient of @cards over @to_come.
+ */
+static uint64_t count_boards(int cards, int to_come)
+{
+	uint64_t count = 1;
+	for (int i = 0; i < to_come; i++)
+		count = count * (uint64_t)(cards - i) / (uint64_t)(i + 1);
+	return count;
+}
+
+/*
+ * equity_boards - Set up the boards that can complete a partial board.
+ * @boards: Where to store the boards.
+ * @config: Configuration of the calculation, choosing between enumerating
+ *          and sampling as for equity_calc().
+ * @board: Board cards already dealt, up to EQUITY_BOARD_SIZE.
+ * @dead: Cards that cannot come besides @board, such as hole cards.
+ * @block: Sampled boards in each unit, greater than 0.
+ *
+ * Return: 0 on success, -1 on error with errno set.
+ */
+int equity_boards(EquityBoards *boards, const EquityConfig *config,
+		  CardSet board, CardSet dead, uint64_t block)
+{
+	if (boards == NULL || config == NULL || block == 0 ||
+	    ((board | dead) & ~CARDSET_FULL) != 0 ||
+	    cardset_size(board) > EQUITY_BOARD_SIZE) {
+		errno = EINVAL;
+		return -1;
+	}
+	memset(boards, 0, sizeof(*boards));
+	boards->board = board;
+	boards->board_key = poker_key(board);
+	for (int bit = 0; bit < STANDARD_DECK_SIZE; bit++)
+		boards->bit_keys[bit] = poker_key((CardSet)1 << bit);
+	boards->deck = CARDSET_FULL & ~(board | dead);
+	for (CardSet rest = boards->deck; rest != 0; rest &= rest - 1) {
+		int bit = __builtin_ctzll(rest);
+		boards->cards[boards->num_cards] = bit;
+		boards->card_keys[boards->num_cards++] = boards->bit_keys[bit];
+	}
+	boards->to_come = EQUITY_BOARD_SIZE - cardset_size(board);
+	uint64_t count = count_boards(boards->num_cards, boards->to_come);
+	boards->exact = count <= config->max_enumerate || config->samples == 0;
+	boards->samples = config->samples;
+	boards->seed = config->seed;
+	boards->block = block;
+	if (boards->exact)
+		boards->units = boards->to_come == 0 ? 1 :
+			(size_t)(boards->num_cards - boards->to_come + 1);
+	else
+		boards->units = (size_t)((config->samples + block - 1) / block);
+	return 0;
+}
+
+/*
+ * enumerate - Visit every way to complete a board.
+ * @boards: Boards being walked.
+ * @depth: Cards still to add.
+ * @start: First position of @boards->cards that may be added.
+ * @key: poker_key() of the board so far.
+ * @board: Board so far.
+ * @visit: Called with @arg for each complete board.
+ * @arg: Passed to @visit.
+ *
+ * Return: Number of boards visited.
+ */
+static uint64_t enumerate(const EquityBoards *boards, int depth, int start,
+			  PokerKey key, CardSet board,
+			  void (*visit)(void *arg, PokerKey key, CardSet board),
+			  void *arg)
+{
+	if (depth == 0) {
+		visit(arg, key, board);
+		return 1;
+	}
+	uint64_t count = 0;
+	for (int i = start; i <= boards->num_cards - depth; i++)
+		count += enumerate(boards, depth - 1, i + 1,
+				   key + boards->card_keys[i],
+				   board | (CardSet)1 << boards->cards[i],
+				   visit, arg);
+	return count;
+}
+
+/*
+ * equity_walk - Visit the boards of one work unit.
+ * @boards: Boards set up by equity_boards().
+ * @unit: Index of the unit, below @boards->units.
+ * @visit: Called with @arg, the poker_key() of a complete board and the
+ *         board itself, for each board of the unit.
+ * @arg: Passed to @visit.
+ *
+ * An enumeration unit covers every board whose first new card is at
+ * position @unit. A sampling unit draws a block of boards from stream @unit
+ * of the seed, so the boards of a unit never depend on which thread runs it.
+ *
+ * Return: Number of boards visited.
+ */
+uint64_t equity_walk(const EquityBoards *boards, size_t unit,
+		     void (*visit)(void *arg, PokerKey key, CardSet board),
+		     void *arg)
+{
+	if (boards->exact) {
+		if (boards->to_come == 0) {
+			visit(arg, boards->board_key, boards->board);
+			return 1;
+		}
+		return enumerate(boards, boards->to_come - 1, (int)unit + 1,
+				 boards->board_key + boards->card_keys[unit],
+				 boards->board |
+					 (CardSet)1 << boards->cards[unit],
+				 visit, arg);
+	}
+	Rng rng;
+	rng_seed(&rng, boards->seed, unit);
+	uint64_t count = boards->samples - (uint64_t)unit * boards->block;
+	if (count > boards->block)
+		count = boards->block;
+	for (uint64_t i = 0; i < count; i++) {
+		CardSet deck = boards->deck, board = boards->board;
+		PokerKey key = boards->board_key;
+		for (int c = 0; c < boards->to_come; c++) {
+			int bit = cardset_select(deck, (int)rng_bounded(&rng,
+					(uint32_t)cardset_size(deck)));
+			deck &= ~((CardSet)1 << bit);
+			board |= (CardSet)1 << bit;
+			key += boards->bit_keys[bit];
+		}
+		visit(arg, key, board);
+	}
+	return count;
+}
+
+/*
+ * showdown - Score a complete board for every player.
+ * @arg: Pointer to the struct equity_local to add the result to.
+ * @key: poker_key() of the complete board.
+ * @board: The complete board.
+ */
+static void showdown(void *arg, PokerKey key, CardSet board)
+{
+	struct equity_local *local = arg;
+	const struct equity_job *job = local->job;
+	struct equity_tally *tally = &local->tally;
+	uint16_t values[EQUITY_MAX_PLAYERS];
+	uint16_t best = 0;
+	int winners = 0;
+	for (size_t p = 0; p < job->num_players; p++) {
+		values[p] = poker_rank(key + job->hole_keys[p],
+				       board | job->holes[p]);
+		if (values[p] > best) {
+			best = values[p];
+			winners = 1;
+		} else if (values[p] == best) {
+			winners++;
+		}
+	}
+	tally->boards++;
+	for (size_t p = 0; p < job->num_players; p++) {
+		if (values[p] != best)
+			continue;
+		if (winners == 1)
+			tally->wins[p]++;
+		else
+			tally->ties[p]++;
+		tally->shares[p] += EQUITY_SHARE_UNIT / winners;
+	}
+}
+
+/*
+ * equity_start - Set up a thread of an equity calculation.
+ * @arg: Pointer to the struct equity_job.
+ *
+ * Return: Pointer to the thread's struct equity_local, or NULL on error with
+ * errno set.
+ */
+static void *equity_start(void *arg)
+{
+	struct equity_local *local = calloc(1, sizeof(*local));
+	if (local == NULL) {
+		errno = ENOMEM;
+		return NULL;
+	}
+	local->job = arg;
+	return local;
+}
+
+/*
+ * equity_item - Score the boards of one work unit on a thread.
+ * @arg: Pointer to the struct equity_job.
+ * @local: Pointer to the thread's struct equity_local.
+ * @unit: Index of the unit.
+ *
+ * Return: 0.
+ */
+static int equity_item(void *arg, void *local, size_t unit)
+{
+	const struct equity_job *job = arg;
+	equity_walk(&job->boards, unit, showdown, local);
+	return 0;
+}
+
+/*
+ * equity_gather - Merge a thread's counts into the job's.
+ * @arg: Pointer to the struct equity_job.
+ * @local: Pointer to the thread's struct equity_local.
+ */
+static void equity_gather(void *arg, void *local)
+{
+	struct equity_job *job = arg;
+	const struct equity_local *thread = local;
+	const struct equity_tally *tally = &thread->tally;
+	job->total.boards += tally->boards;
+	for (size_t p = 0; p < job->num_players; p++) {
+		job->total.wins[p] += tally->wins[p];
+		job->total.ties[p] += tally->ties[p];
+		job->total.shares[p] += tally->shares[p];
+	}
+}
+
+/*
+ * equity_finish - Free a thread of an equity calculation.
+ * @arg: Pointer to the struct equity_job.
+ * @local: Pointer to the thread's struct equity_local.
+ */
+static void equity_finish(void *arg, void *local)
+{
+	(void)arg;
+	free(local);
+}
+
+/*
+ * equity_calc - Calculate the pot equity of Texas Hold'em hands.
+ * @config: Configuration of the calculation.
+ * @holes: Two hole cards for each player.
+ * @num_players: Number of players, 2 to EQUITY_MAX_PLAYERS.
+ * @board: Board cards already dealt, up to EQUITY_BOARD_SIZE.
+ * @result: Where to store the result.
+ *
+ * Every completion of the board is enumerated if there are no more than
+ * @config->max_enumerate of them, spread over threads by the first new
+ * card. Otherwise @config->samples boards are drawn in seeded blocks. Hands
+ * are ranked with poker_rank(), building its tables on first use. Heads-up
+ * preflop, 1,712,304 boards, takes about 30 milliseconds on one core.
+ *
+ * Return: 0 on success, -1 on error with errno set.
+ */
+int equity_calc(const EquityConfig *config, const CardSet *holes,
+		size_t num_players, CardSet board, EquityResult *result)
+{
+	if (config == NULL || holes == NULL || result == NULL ||
+	    num_players < 2 || num_players > EQUITY_MAX_PLAYERS ||
+	    (board & ~CARDSET_FULL) != 0 ||
+	    cardset_size(board) > EQUITY_BOARD_SIZE) {
+		errno = EINVAL;
+		return -1;
+	}
+	CardSet used = board;
+	for (size_t p = 0; p < num_players; p++) {
+		if ((holes[p] & ~CARDSET_FULL) != 0 ||
+		    cardset_size(holes[p]) != HOLE_CARDS ||
+		    (holes[p] & used) != 0) {
+			errno = EINVAL;
+			return -1;
+		}
+		used |= holes[p];
+	}
+	if (poker_init() < 0)
+		return -1;
+
+	struct equity_job *job = calloc(1, sizeof(*job));
+	if (job == NULL) {
+		errno = ENOMEM;
+		return -1;
+	}
+	job->holes = holes;
+	job->num_players = num_players;
+	for (size_t p = 0; p < num_players; p++)
+		job->hole_keys[p] = poker_key(holes[p]);
+	equity_boards(&job->boards, config, board, used, SAMPLE_BLOCK);
+	PoolTask task = {
+		.items = job->boards.units,
+		.threads = config->threads,
+		.arg = job,
+		.start = equity_start,
+		.item = equity_item,
+		.merge = equity_gather,
+		.finish = equity_finish,
+	};
+	if (pool_run(&task) < 0) {
+		free(job);
+		return -1;
+	}
+
+	memset(result, 0, sizeof(*result));
+	result->boards = job->total.boards;
+	result->exact = job->boards.exact;
+	for (size_t p = 0; p < num_players; p++) {
+		result->wins[p] = job->total.wins[p];
+		result->ties[p] = job->total.ties[p];
+		result->shares[p] = job->total.shares[p];
+		if (result->boards == 0)
+			continue;
+		double boards_played = (double)result->boards;
+		result->win[p] = (double)result->wins[p] / boards_played;
+		result->tie[p] = (double)result->ties[p] / boards_played;
+		result->equity[p] = (double)result->shares[p] /
+				    (boards_played * EQUITY_SHARE_UNIT);
+	}
+	free(job);
+	return 0;
+}
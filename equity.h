@@ -0,0 +1,100 @@
+#ifndef EQUITY_H
+#define EQUITY_H
+
+#include <stddef.h> // provides size_t
+#include <stdint.h> // provides uint64_t
+#include "cardset.h"
+#include "poker.h"
+
+#define EQUITY_MAX_PLAYERS 10
+#define EQUITY_BOARD_SIZE 5
+#define EQUITY_SHARE_UNIT 2520 // Divisible by every split of a pot up to 10
+
+/*
+ * struct equity_config - Parameters of an equity calculation.
+ * @threads: Number of threads, 0 or 1 to run on the calling thread.
+ * @max_enumerate: Enumerate every board if no more than this many remain,
+ *                 otherwise sample.
+ * @samples: Number of boards to sample when not enumerating, 0 to always
+ *           enumerate.
+ * @seed: Seed of the sampled boards, block n of samples uses stream n.
+ */
+typedef struct equity_config {
+	int threads;
+	uint64_t max_enumerate;
+	uint64_t samples;
+	uint64_t seed;
+} EquityConfig;
+
+/*
+ * struct equity_result - Outcome of an equity calculation.
+ * @boards: Number of boards evaluated.
+ * @exact: If every remaining board was enumerated.
+ * @wins: Boards each player won outright.
+ * @ties: Boards each player split with others.
+ * @shares: Pots won by each player in 1/EQUITY_SHARE_UNIT parts, counting
+ *          split pots fractionally.
+ * @win: Probability of each player winning outright.
+ * @tie: Probability of each player splitting the pot.
+ * @equity: Expected share of the pot of each player.
+ *
+ * The counts are integers, so the result is the same for any number of
+ * threads.
+ */
+typedef struct equity_result {
+	uint64_t boards;
+	_Bool exact;
+	uint64_t wins[EQUITY_MAX_PLAYERS];
+	uint64_t ties[EQUITY_MAX_PLAYERS];
+	uint64_t shares[EQUITY_MAX_PLAYERS];
+	double win[EQUITY_MAX_PLAYERS];
+	double tie[EQUITY_MAX_PLAYERS];
+	double equity[EQUITY_MAX_PLAYERS];
+} EquityResult;
+
+/*
+ * struct equity_boards - The boards that can complete a partial board.
+ * @board: Known board cards.
+ * @board_key: poker_key() of @board.
+ * @deck: Cards that can still come.
+ * @cards: CardSet bits of @deck in order, for enumeration.
+ * @card_keys: poker_key() of each card in @cards.
+ * @bit_keys: poker_key() of each card, indexed by its CardSet bit.
+ * @num_cards: Number of cards in @deck.
+ * @to_come: Board cards still to come.
+ * @exact: If every board is enumerated rather than sampled.
+ * @samples: Number of boards sampled when not enumerating.
+ * @seed: Seed of the sampled boards, unit n uses stream n.
+ * @block: Sampled boards in each unit.
+ * @units: Number of work units, first cards when enumerating or sample
+ *         blocks when sampling.
+ *
+ * Set up by equity_boards() and walked a unit at a time by equity_walk(), so
+ * any calculation over the boards splits into the same units.
+ */
+typedef struct equity_boards {
+	CardSet board;
+	PokerKey board_key;
+	CardSet deck;
+	int cards[STANDARD_DECK_SIZE];
+	PokerKey card_keys[STANDARD_DECK_SIZE];
+	PokerKey bit_keys[STANDARD_DECK_SIZE];
+	int num_cards;
+	int to_come;
+	_Bool exact;
+	uint64_t samples;
+	uint64_t seed;
+	uint64_t block;
+	size_t units;
+} EquityBoards;
+
+/* Function prototypes. */
+int equity_boards(EquityBoards *boards, const EquityConfig *config,
+		  CardSet board, CardSet dead, uint64_t block);
+uint64_t equity_walk(const EquityBoards *boards, size_t unit,
+		     void (*visit)(void *arg, PokerKey key, CardSet board),
+		     void *arg);
+int equity_calc(const EquityConfig *config, const CardSet *holes,
+		size_t num_players, CardSet board, EquityResult *result);
+
+#endif // EQUITY_H
@@ -0,0 +1,681 @@
+/*
+ * exact.c - Exact blackjack expectation by combinatorial analysis.
+ */
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include "exact.h"
+
+#define DEALER_OUTCOMES 7 // Bust, 17 to 21 and blackjack
+#define DEALER_BLACKJACK 6
+#define MEMO_INITIAL 4096
+#define KEY_BITS 6 // Bits per rank in a memo key
+
+/*
+ * struct memo_key - Key of a memoised subproblem.
+ * @removed: Cards missing from the reference shoe, KEY_BITS per rank class.
+ * @state: Upcard plus one, and for player subproblems the player's hand.
+ *
+ * Keying on the cards missing from a shared reference shoe rather than on
+ * the player's cards lets perturbed shoes reuse each other's subproblems: a
+ * shoe short one five holding a ten sees the same dealer as the full shoe
+ * holding a five and a ten.
+ */
+struct memo_key {
+	uint64_t removed;
+	uint64_t state;
+};
+
+/*
+ * struct memo - Open-addressed hash table of memoised subproblems.
+ * @keys: Slot keys, a zero @state marks an empty slot.
+ * @values: @width doubles per slot.
+ * @width: Number of doubles stored per key.
+ * @capacity: Number of slots, a power of two.
+ * @used: Number of occupied slots.
+ */
+struct memo {
+	struct memo_key *keys;
+	double *values;
+	size_t width;
+	size_t capacity;
+	size_t used;
+};
+
+/*
+ * struct exact_ctx - State of one thread of an exact calculation.
+ * @rules: Rules of the calculation.
+ * @shoe: Cards left in the shoe for each rank class.
+ * @total: Total cards left in the shoe.
+ * @removed: Packed counts of the cards missing from the reference shoe.
+ * @upcard: Rank class of the dealer's upcard.
+ * @dealer: Dealer outcome probabilities.
+ * @player: Player expectations.
+ */
+struct exact_ctx {
+	const ExactRules *rules;
+	unsigned shoe[EXACT_RANKS];
+	unsigned total;
+	uint64_t removed;
+	int upcard;
+	struct memo dealer;
+	struct memo player;
+};
+
+/*
+ * struct exact_job - Work shared by the threads of an exact calculation.
+ * @rules: Rules of the calculation.
+ * @reference: Shoe every shoe in @shoes is a subset of.
+ * @shoes: Compositions of the shoes to evaluate.
+ * @num_shoes: Number of shoes to evaluate.
+ * @next: Next upcard to evaluate.
+ * @ev: Contribution of each upcard to each shoe's expectation.
+ * @error: errno of the first failure, or 0.
+ *
+ * Threads take an upcard at a time and evaluate it for every shoe in turn,
+ * so each shoe after the first is mostly answered from the memo tables.
+ */
+struct exact_job {
+	const ExactRules *rules;
+	const unsigned *reference;
+	const unsigned (*shoes)[EXACT_RANKS];
+	size_t num_shoes;
+	atomic_int next;
+	double (*ev)[EXACT_RANKS];
+	atomic_int error;
+};
+
+/*
+ * rank_value - Blackjack value of a rank class, counting an ace as 1.
+ * @rank: Rank class, 0 for aces through 9 for ten-valued cards.
+ *
+ * Return: Value of the rank class.
+ */
+static int rank_value(int rank)
+{
+	return rank + 1;
+}
+
+/*
+ * memo_init - Allocate an empty memo table.
+ * @memo: Table to initialise.
+ * @width: Number of doubles stored per key.
+ * @capacity: Number of slots, a power of two.
+ *
+ * Return: 0 on success, -1 on error with errno set.
+ */
+static int memo_init(struct memo *memo, size_t width, size_t capacity)
+{
+	memo->keys = calloc(capacity, sizeof(*memo->keys));
+	memo->values = malloc(capacity * width * sizeof(*memo->values));
+	if (memo->keys == NULL || memo->values == NULL) {
+		free(memo->keys);
+		free(memo->values);
+		errno = ENOMEM;
+		return -1;
+	}
+	memo->width = width;
+	memo->capacity = capacity;
+	memo->used = 0;
+	return 0;
+}
+
+/*
+ * memo_free - Free a memo table's storage.
+ * @memo: Table to free.
+ */
+static void memo_free(struct memo *memo)
+{
+	free(memo->keys);
+	free(memo->values);
+	memo->keys = NULL;
+	memo->values = NULL;
+}
+
+/*
+ * memo_slot - Find the slot holding a key, or the empty slot it belongs in.
+ * @memo: Table to search.
+ * @key: Key to find.
+ *
+ * Return: Index of the slot.
+ */
+static size_t memo_slot(const struct memo *memo, struct memo_key key)
+{
+	uint64_t hash = (key.removed ^ (key.state * 0xC2B2AE3D27D4EB4FULL)) *
+			0x9E3779B97F4A7C15ULL;
+	size_t mask = memo->capacity - 1;
+	size_t slot = (size_t)(hash >> 20) & mask;
+	while (memo->keys[slot].state != 0 &&
+	       (memo->keys[slot].state != key.state ||
+		memo->keys[slot].removed != key.removed))
+		slot = (slot + 1) & mask;
+	return slot;
+}
+
+/*
+ * memo_get - Look up a memoised subproblem.
+ * @memo: Table to search.
+ * @key: Key of the subproblem, with a non-zero state.
+ *
+ * Return: Stored values, valid until the next memo_put(), or NULL.
+ */
+static const double *memo_get(const struct memo *memo, struct memo_key key)
+{
+	size_t slot = memo_slot(memo, key);
+	if (memo->keys[slot].state == 0)
+		return NULL;
+	return &memo->values[slot * memo->width];
+}
+
+/*
+ * memo_put - Memoise a subproblem, growing the table when half full.
+ * @memo: Table to insert into.
+ * @key: Key of the subproblem, with a non-zero state.
+ * @values: @memo->width values to store.
+ *
+ * Return: 0 on success, -1 on error with errno set.
+ */
+static int memo_put(struct memo *memo, struct memo_key key,
+		    const double *values)
+{
+	if (2 * (memo->used + 1) > memo->capacity) {
+		struct memo grown;
+		if (memo_init(&grown, memo->width, memo->capacity * 2) < 0)
+			return -1;
+		for (size_t i = 0; i < memo->capacity; i++) {
+			if (memo->keys[i].state == 0)
+				continue;
+			size_t slot = memo_slot(&grown, memo->keys[i]);
+			grown.keys[slot] = memo->keys[i];
+			memcpy(&grown.values[slot * grown.width],
+			       &memo->values[i * memo->width],
+			       memo->width * sizeof(double));
+		}
+		grown.used = memo->used;
+		memo_free(memo);
+		*memo = grown;
+	}
+	size_t slot = memo_slot(memo, key);
+	if (memo->keys[slot].state == 0)
+		memo->used++;
+	memo->keys[slot] = key;
+	memcpy(&memo->values[slot * memo->width], values,
+	       memo->width * sizeof(double));
+	return 0;
+}
+
+/*
+ * take - Remove a card of a rank class from the shoe into the player's hand.
+ * @ctx: Calculation state.
+ * @rank: Rank class of the card.
+ */
+static void take(struct exact_ctx *ctx, int rank)
+{
+	ctx->shoe[rank]--;
+	ctx->total--;
+	ctx->removed += (uint64_t)1 << (rank * KEY_BITS);
+}
+
+/*
+ * put_back - Undo take().
+ * @ctx: Calculation state.
+ * @rank: Rank class of the card.
+ */
+static void put_back(struct exact_ctx *ctx, int rank)
+{
+	ctx->shoe[rank]++;
+	ctx->total++;
+	ctx->removed -= (uint64_t)1 << (rank * KEY_BITS);
+}
+
+/*
+ * dealer_key - Key of the dealer's subproblem for the current shoe.
+ * @ctx: Calculation state.
+ *
+ * Return: Key of the subproblem.
+ */
+static struct memo_key dealer_key(const struct exact_ctx *ctx)
+{
+	return (struct memo_key){ ctx->removed, (uint64_t)ctx->upcard + 1 };
+}
+
+/*
+ * player_key - Key of the player's subproblem for the current shoe.
+ * @ctx: Calculation state.
+ * @hard: Player's total counting aces as 1.
+ * @ace: If the player holds an ace.
+ *
+ * Return: Key of the subproblem.
+ */
+static struct memo_key player_key(const struct exact_ctx *ctx, int hard,
+				  _Bool ace)
+{
+	uint64_t state = (uint64_t)ctx->upcard + 1;
+	state |= (uint64_t)hard << 4 | (uint64_t)ace << 9;
+	return (struct memo_key){ ctx->removed, state };
+}
+
+/*
+ * dealer_draw - Enumerate the dealer's draws from the current shoe.
+ * @ctx: Calculation state.
+ * @hard: Dealer's total counting aces as 1.
+ * @ace: If the dealer holds an ace.
+ * @cards: Number of cards the dealer holds.
+ * @prob: Probability of reaching this hand.
+ * @dist: Outcome probabilities to add to.
+ */
+static void dealer_draw(struct exact_ctx *ctx, int hard, _Bool ace, int cards,
+			double prob, double *dist)
+{
+	_Bool soft = ace && hard + 10 <= 21;
+	int total = soft ? hard + 10 : hard;
+	if (cards >= BLACKJACK_INITIAL_DEAL) {
+		if (total > 21) {
+			dist[0] += prob;
+			return;
+		}
+		if (total >= 17 &&
+		    !(ctx->rules->hit_soft_17 && total == 17 && soft)) {
+			if (cards == BLACKJACK_INITIAL_DEAL && total == 21)
+				dist[DEALER_BLACKJACK] += prob;
+			else
+				dist[total - 16] += prob;
+			return;
+		}
+	}
+	double per_card = prob / ctx->total;
+	for (int rank = 0; rank < EXACT_RANKS; rank++) {
+		if (ctx->shoe[rank] == 0)
+			continue;
+		double next = per_card * ctx->shoe[rank];
+		ctx->shoe[rank]--;
+		ctx->total--;
+		dealer_draw(ctx, hard + rank_value(rank), ace || rank == 0,
+			    cards + 1, next, dist);
+		ctx->shoe[rank]++;
+		ctx->total++;
+	}
+}
+
+/*
+ * dealer_outcomes - Probabilities of the dealer's final hands.
+ * @ctx: Calculation state, with the upcard and player's cards removed.
+ *
+ * Return: DEALER_OUTCOMES probabilities, valid until the next memo_put() on
+ * the dealer table, or NULL on error with errno set.
+ */
+static const double *dealer_outcomes(struct exact_ctx *ctx)
+{
+	struct memo_key key = dealer_key(ctx);
+	const double *dist = memo_get(&ctx->dealer, key);
+	if (dist != NULL)
+		return dist;
+	double fresh[DEALER_OUTCOMES] = { 0 };
+	dealer_draw(ctx, rank_value(ctx->upcard), ctx->upcard == 0, 1, 1.0,
+		    fresh);
+	if (memo_put(&ctx->dealer, key, fresh) < 0)
+		return NULL;
+	return memo_get(&ctx->dealer, key);
+}
+
+/*
+ * stand_ev - Player's expectation standing on a score.
+ * @ctx: Calculation state, with the upcard and player's cards removed.
+ * @score: Player's blackjack_score(), not a bust.
+ * @ev: Where to store the expectation.
+ *
+ * Return: 0 on success, -1 on error with errno set.
+ */
+static int stand_ev(struct exact_ctx *ctx, int score, double *ev)
+{
+	const double *dist = dealer_outcomes(ctx);
+	if (dist == NULL)
+		return -1;
+	double sum = 0.0;
+	for (int outcome = 0; outcome < DEALER_OUTCOMES; outcome++) {
+		int dealer = outcome == 0 ? 0 :
+			     outcome == DEALER_BLACKJACK ? 22 : outcome + 16;
+		sum += dist[outcome] * blackjack_net(score, dealer) / 2.0;
+	}
+	*ev = sum;
+	return 0;
+}
+
+/*
+ * player_ev - Player's expectation playing on from a hand.
+ * @ctx: Calculation state, with the upcard and player's cards removed.
+ * @hard: Player's total counting aces as 1.
+ * @ace: If the player holds an ace.
+ * @cards: Number of cards the player holds.
+ * @ev: Where to store the expectation.
+ *
+ * Return: 0 on success, -1 on error with errno set.
+ */
+static int player_ev(struct exact_ctx *ctx, int hard, _Bool ace, int cards,
+		     double *ev)
+{
+	_Bool soft = ace && hard + 10 <= 21;
+	int total = soft ? hard + 10 : hard;
+	if (total > 21) {
+		*ev = -1.0; // A bust loses before the dealer plays
+		return 0;
+	}
+	if (cards == BLACKJACK_INITIAL_DEAL && total == 21)
+		return stand_ev(ctx, 22, ev);
+	if (total == 21)
+		return stand_ev(ctx, 21, ev);
+
+	struct memo_key key = player_key(ctx, hard, ace);
+	const double *memo = memo_get(&ctx->player, key);
+	if (memo != NULL) {
+		*ev = *memo;
+		return 0;
+	}
+	double stand;
+	if (stand_ev(ctx, total, &stand) < 0)
+		return -1;
+	double best = stand;
+	if (ctx->rules->strategy == EXACT_COMPOSITION ||
+	    blackjack_strategy(total, soft, ctx->upcard == 0 ?
+					11 : rank_value(ctx->upcard)) == 'h') {
+		double hit = 0.0;
+		unsigned left = ctx->total;
+		for (int rank = 0; rank < EXACT_RANKS; rank++) {
+			if (ctx->shoe[rank] == 0)
+				continue;
+			double prob = (double)ctx->shoe[rank] / left;
+			double next;
+			take(ctx, rank);
+			int ret = player_ev(ctx, hard + rank_value(rank),
+					    ace || rank == 0, cards + 1, &next);
+			put_back(ctx, rank);
+			if (ret < 0)
+				return -1;
+			hit += prob * next;
+		}
+		if (ctx->rules->strategy == EXACT_BASIC || hit > stand)
+			best = hit;
+	}
+	if (memo_put(&ctx->player, key, &best) < 0)
+		return -1;
+	*ev = best;
+	return 0;
+}
+
+/*
+ * upcard_ev - Player's expectation given the dealer's upcard.
+ * @ctx: Calculation state, with the upcard removed.
+ * @ev: Where to store the expectation.
+ *
+ * Weighs every initial two-card player hand by its probability.
+ *
+ * Return: 0 on success, -1 on error with errno set.
+ */
+static int upcard_ev(struct exact_ctx *ctx, double *ev)
+{
+	double sum = 0.0;
+	for (int first = 0; first < EXACT_RANKS; first++) {
+		if (ctx->shoe[first] == 0)
+			continue;
+		double p_first = (double)ctx->shoe[first] / ctx->total;
+		take(ctx, first);
+		for (int second = 0; second < EXACT_RANKS; second++) {
+			if (ctx->shoe[second] == 0)
+				continue;
+			double p_second = (double)ctx->shoe[second] / ctx->total;
+			double hand;
+			take(ctx, second);
+			int ret = player_ev(ctx,
+					    rank_value(first) + rank_value(second),
+					    first == 0 || second == 0,
+					    BLACKJACK_INITIAL_DEAL, &hand);
+			put_back(ctx, second);
+			if (ret < 0) {
+				put_back(ctx, first);
+				return -1;
+			}
+			sum += p_first * p_second * hand;
+		}
+		put_back(ctx, first);
+	}
+	*ev = sum;
+	return 0;
+}
+
+/*
+ * exact_work - Evaluate upcards until none are left.
+ * @arg: Pointer to the shared struct exact_job.
+ *
+ * Each thread keeps its own memo tables, so no locking is needed.
+ *
+ * Return: NULL, failures are recorded in the job.
+ */
+static void *exact_work(void *arg)
+{
+	struct exact_job *job = arg;
+	struct exact_ctx ctx = { .rules = job->rules };
+	if (memo_init(&ctx.dealer, DEALER_OUTCOMES, MEMO_INITIAL) < 0) {
+		atomic_store(&job->error, errno);
+		return NULL;
+	}
+	if (memo_init(&ctx.player, 1, MEMO_INITIAL) < 0) {
+		atomic_store(&job->error, errno);
+		memo_free(&ctx.dealer);
+		return NULL;
+	}
+	int upcard;
+	while ((upcard = atomic_fetch_add(&job->next, 1)) < EXACT_RANKS) {
+		for (size_t i = 0; i < job->num_shoes; i++) {
+			const unsigned *shoe = job->shoes[i];
+			job->ev[i][upcard] = 0.0;
+			if (shoe[upcard] == 0)
+				continue;
+			ctx.total = 0;
+			ctx.removed = 0;
+			for (int rank = 0; rank < EXACT_RANKS; rank++) {
+				ctx.shoe[rank] = shoe[rank];
+				ctx.total += shoe[rank];
+				ctx.removed += (uint64_t)(job->reference[rank] -
+							  shoe[rank])
+					       << (rank * KEY_BITS);
+			}
+			double p_upcard = (double)shoe[upcard] / ctx.total;
+			ctx.upcard = upcard;
+			take(&ctx, upcard);
+			double ev;
+			if (upcard_ev(&ctx, &ev) < 0) {
+				atomic_store(&job->error, errno);
+				goto out;
+			}
+			job->ev[i][upcard] = p_upcard * ev;
+		}
+	}
+out:
+	memo_free(&ctx.dealer);
+	memo_free(&ctx.player);
+	return NULL;
+}
+
+/*
+ * exact_run - Evaluate several shoes drawn from a common reference shoe.
+ * @rules: Rules of the calculation.
+ * @reference: Shoe every shoe in @shoes is a subset of.
+ * @shoes: Compositions of the shoes to evaluate.
+ * @num_shoes: Number of shoes to evaluate.
+ * @ev: Where to store each shoe's expectation.
+ *
+ * Return: 0 on success, -1 on error with errno set.
+ */
+static int exact_run(const ExactRules *rules, const unsigned *reference,
+		     const unsigned (*shoes)[EXACT_RANKS], size_t num_shoes,
+		     double *ev)
+{
+	for (size_t i = 0; i < num_shoes; i++) {
+		unsigned total = 0;
+		for (int rank = 0; rank < EXACT_RANKS; rank++) {
+			// Leave room in the key for the cards a round removes
+			if (shoes[i][rank] > reference[rank] ||
+			    reference[rank] - shoes[i][rank] > 16) {
+				errno = EINVAL;
+				return -1;
+			}
+			total += shoes[i][rank];
+		}
+		// Too few cards and a round could run the shoe dry
+		if (total < STANDARD_DECK_SIZE / 2) {
+			errno = EINVAL;
+			return -1;
+		}
+	}
+	double (*upcards)[EXACT_RANKS] = calloc(num_shoes, sizeof(*upcards));
+	if (upcards == NULL) {
+		errno = ENOMEM;
+		return -1;
+	}
+	struct exact_job job = {
+		.rules = rules,
+		.reference = reference,
+		.shoes = shoes,
+		.num_shoes = num_shoes,
+		.ev = upcards,
+	};
+	atomic_init(&job.next, 0);
+	atomic_init(&job.error, 0);
+
+	size_t count = rules->threads > 1 ? (size_t)rules->threads : 1;
+	if (count > EXACT_RANKS)
+		count = EXACT_RANKS;
+	pthread_t threads[EXACT_RANKS];
+	size_t started = 0;
+	for (; started + 1 < count; started++) {
+		int err = pthread_create(&threads[started], NULL, exact_work,
+					 &job);
+		if (err != 0)
+			break; // The calling thread picks up the slack
+	}
+	exact_work(&job);
+	for (size_t i = 0; i < started; i++)
+		pthread_join(threads[i], NULL);
+	int error = atomic_load(&job.error);
+	if (error == 0) {
+		for (size_t i = 0; i < num_shoes; i++) {
+			ev[i] = 0.0;
+			for (int upcard = 0; upcard < EXACT_RANKS; upcard++)
+				ev[i] += upcards[i][upcard];
+		}
+	}
+	free(upcards);
+	if (error != 0) {
+		errno = error;
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * exact_shoe - Composition of a fresh shoe by rank class.
+ * @packs: Number of standard packs in the shoe.
+ * @counts: Array of EXACT_RANKS counts to fill, aces first and the
+ *          ten-valued cards last.
+ *
+ * Return: 0 on success, -1 on error with errno set.
+ */
+int exact_shoe(int packs, unsigned *counts)
+{
+	if (packs < 1 || counts == NULL) {
+		errno = EINVAL;
+		return -1;
+	}
+	for (int rank = 0; rank < EXACT_RANKS - 1; rank++)
+		counts[rank] = 4 * (unsigned)packs;
+	counts[EXACT_RANKS - 1] = 16 * (unsigned)packs;
+	return 0;
+}
+
+/*
+ * exact_ev - Exact player expectation of a round of blackjack.
+ * @rules: Rules of the round.
+ * @counts: Composition of the shoe as from exact_shoe(), or NULL for a fresh
+ *          shoe of @rules->packs packs. Must hold at least half a pack.
+ * @ev: Where to store the player's expectation per round, the house edge is
+ *      its negation.
+ *
+ * Enumerates every upcard, initial hand, player draw and dealer draw,
+ * weighting each by its probability drawn without replacement from @counts.
+ * Dealer outcome distributions and player expectations are memoised on the
+ * cards removed from the shoe, and the ten upcards are shared between
+ * @rules->threads threads. The result is exact up to floating point rounding.
+ *
+ * Return: 0 on success, -1 on error with errno set.
+ */
+int exact_ev(const ExactRules *rules, const unsigned *counts, double *ev)
+{
+	if (rules == NULL || ev == NULL) {
+		errno = EINVAL;
+		return -1;
+	}
+	unsigned shoe[1][EXACT_RANKS];
+	if (counts == NULL) {
+		if (exact_shoe(rules->packs, shoe[0]) < 0)
+			return -1;
+	} else {
+		memcpy(shoe[0], counts, sizeof(shoe[0]));
+	}
+	return exact_run(rules, shoe[0], (const unsigned (*)[EXACT_RANKS])shoe,
+			 1, ev);
+}
+
+/*
+ * exact_eor - Effects of removal of each rank class.
+ * @rules: Rules of the calculation.
+ * @counts: Composition of the shoe as from exact_shoe(), or NULL for a fresh
+ *          shoe of @rules->packs packs.
+ * @ev: Where to store the player's expectation for the full shoe, may be
+ *      NULL.
+ * @eor: Array of EXACT_RANKS to fill with the change in the player's
+ *       expectation when one card of each rank class is removed.
+ *
+ * Evaluates the shoe and its ten one-card-short neighbours together. The
+ * neighbours share the full shoe's memo tables, so most of their dealer
+ * distributions and player expectations are reused rather than recomputed,
+ * and every upcard is still evaluated in parallel. Rank classes with no
+ * cards left get an effect of 0.
+ *
+ * Return: 0 on success, -1 on error with errno set.
+ */
+int exact_eor(const ExactRules *rules, const unsigned *counts, double *ev,
+	      double *eor)
+{
+	if (rules == NULL || eor == NULL) {
+		errno = EINVAL;
+		return -1;
+	}
+	unsigned shoes[EXACT_RANKS + 1][EXACT_RANKS];
+	if (counts == NULL) {
+		if (exact_shoe(rules->packs, shoes[0]) < 0)
+			return -1;
+	} else {
+		memcpy(shoes[0], counts, sizeof(shoes[0]));
+	}
+	size_t num_shoes = 1;
+	int shoe_of[EXACT_RANKS];
+	for (int rank = 0; rank < EXACT_RANKS; rank++) {
+		shoe_of[rank] = -1;
+		if (shoes[0][rank] == 0)
+			continue;
+		memcpy(shoes[num_shoes], shoes[0], sizeof(shoes[0]));
+		shoes[num_shoes][rank]--;
+		shoe_of[rank] = (int)num_shoes++;
+	}
+	double evs[EXACT_RANKS + 1];
+	if (exact_run(rules, shoes[0], (const unsigned (*)[EXACT_RANKS])shoes,
+		      num_shoes, evs) < 0)
+		return -1;
+	for (int rank = 0; rank < EXACT_RANKS; rank++)
+		eor[rank] = shoe_of[rank] < 0 ? 0.0 : evs[shoe_of[rank]] - evs[0];
+	if (ev != NULL)
+		*ev = evs[0];
+	return 0;
+}
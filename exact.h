@@ -0,0 +1,38 @@
+#ifndef EXACT_H
+#define EXACT_H
+
+#include "cards.h"
+
+#define EXACT_RANKS 10 // Ace, two to nine and the ten-valued cards
+
+/* How the player decides to hit or stick in an exact calculation. */
+typedef enum exact_strategy {
+	EXACT_BASIC, /* Follow blackjack_strategy() on the hand's total */
+	EXACT_COMPOSITION /* Choose the best play for the exact cards held */
+} ExactStrategy;
+
+/*
+ * struct exact_rules - Rules of an exact blackjack calculation.
+ * @packs: Number of packs in the shoe.
+ * @hit_soft_17: If the dealer hits soft 17.
+ * @strategy: Strategy the player follows.
+ * @threads: Number of threads to spread the dealer's upcards over.
+ *
+ * Rounds are scored by blackjack_net(): a player bust loses whatever the
+ * dealer's hand, the dealer otherwise plays out their hand and a winning
+ * blackjack pays 3 to 2. The player only hits or stands.
+ */
+typedef struct exact_rules {
+	int packs;
+	_Bool hit_soft_17;
+	ExactStrategy strategy;
+	int threads;
+} ExactRules;
+
+/* Function prototypes. */
+int exact_shoe(int packs, unsigned *counts);
+int exact_ev(const ExactRules *rules, const unsigned *counts, double *ev);
+int exact_eor(const ExactRules *rules, const unsigned *counts, double *ev,
+	      double *eor);
+
+#endif // EXACT_H
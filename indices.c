@@ -0,0 +1,474 @@
+/*
+ * indices.c - Index plays for counting players by simulation.
+ */
+#include <errno.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "exact.h"
+#include "indices.h"
+#include "pool.h"
+
+#define TRIAL_BLOCK 1024 // Trials handed to a thread at a time
+#define MAX_FUTURE 64 // Cards a round can draw after the initial deal
+#define MIN_BIN_SHARE 100 // Bins with under 1/100 of the trials are noise
+
+/*
+ * struct index_job - Work shared by the threads of an index search.
+ * @config: Configuration of the search.
+ * @plays: Plays to search, their bins hold the merged tallies.
+ * @num_plays: Number of plays.
+ */
+struct index_job {
+	const IndexConfig *config;
+	IndexPlay *plays;
+	size_t num_plays;
+};
+
+/*
+ * struct index_local - Tallies of one thread of an index search.
+ * @trials: Trials of each play in each count bin.
+ * @gain: Summed stick minus hit result of each play in each count bin.
+ */
+struct index_local {
+	uint64_t (*trials)[COUNT_BINS];
+	int64_t (*gain)[COUNT_BINS];
+};
+
+/*
+ * struct future - Cards still to come in a trial, drawn on demand.
+ * @shoe: Cards left in the shoe for each rank class.
+ * @total: Total cards left in the shoe.
+ * @cards: Rank classes drawn so far, in order.
+ * @drawn: Number of cards drawn.
+ * @rng: Generator the cards are drawn with.
+ *
+ * Both plays of a trial read the same sequence, so they are compared on
+ * common random numbers.
+ */
+struct future {
+	unsigned shoe[EXACT_RANKS];
+	unsigned total;
+	int cards[MAX_FUTURE];
+	int drawn;
+	Rng *rng;
+};
+
+/*
+ * struct hand_total - Running total of a blackjack hand.
+ * @hard: Total counting aces as 1.
+ * @ace: If the hand holds an ace.
+ * @cards: Number of cards in the hand.
+ */
+struct hand_total {
+	int hard;
+	_Bool ace;
+	int cards;
+};
+
+/*
+ * draw - Draw a random card from a shoe of rank class counts.
+ * @shoe: Cards left for each rank class.
+ * @total: Total cards left, must be greater than 0.
+ * @rng: Generator to draw with.
+ *
+ * Return: Rank class of the card drawn.
+ */
+static int draw(unsigned *shoe, unsigned *total, Rng *rng)
+{
+	uint32_t pick = rng_bounded(rng, *total);
+	int rank = 0;
+	while (pick >= shoe[rank]) {
+		pick -= shoe[rank];
+		rank++;
+	}
+	shoe[rank]--;
+	(*total)--;
+	return rank;
+}
+
+/*
+ * hilo_tag - Hi-Lo count tag of a rank class.
+ * @rank: Rank class, 0 for aces through 9 for ten-valued cards.
+ *
+ * Return: +1 for two to six, -1 for tens and aces, otherwise 0.
+ */
+static int hilo_tag(int rank)
+{
+	if (rank >= 1 && rank <= 5)
+		return 1;
+	return (rank == 0 || rank == 9) ? -1 : 0;
+}
+
+/*
+ * future_card - Card at a position of a trial's future.
+ * @future: Future of the trial.
+ * @position: Position of the card, counting from the dealer's hole card.
+ *
+ * Return: Rank class of the card, or -1 if the shoe ran dry.
+ */
+static int future_card(struct future *future, int position)
+{
+	while (future->drawn <= position) {
+		if (future->total == 0 || future->drawn == MAX_FUTURE)
+			return -1;
+		future->cards[future->drawn++] =
+			draw(future->shoe, &future->total, future->rng);
+	}
+	return future->cards[position];
+}
+
+/*
+ * add_card - Add a rank class to a hand total.
+ * @hand: Hand to add to.
+ * @rank: Rank class of the card.
+ */
+static void add_card(struct hand_total *hand, int rank)
+{
+	hand->hard += rank + 1;
+	hand->ace = hand->ace || rank == 0;
+	hand->cards++;
+}
+
+/*
+ * hand_score - Score of a hand as blackjack_score() scores it.
+ * @hand: Hand to score.
+ * @soft: Set if an ace counts as 11, may be NULL.
+ *
+ * Return: Score, 22 for a blackjack and 0 for a bust.
+ */
+static int hand_score(const struct hand_total *hand, _Bool *soft)
+{
+	_Bool is_soft = hand->ace && hand->hard + 10 <= 21;
+	int total = is_soft ? hand->hard + 10 : hand->hard;
+	if (soft != NULL)
+		*soft = is_soft;
+	if (total > 21)
+		return 0;
+	if (hand->cards == BLACKJACK_INITIAL_DEAL && total == 21)
+		return 22;
+	return total;
+}
+
+/*
+ * play_out - Finish a trial after the player's first decision.
+ * @config: Configuration of the search.
+ * @player: Player's initial hand.
+ * @upcard: Rank class of the dealer's upcard.
+ * @hit: If the player hits, then follows blackjack_strategy().
+ * @future: Cards to come, the first is the dealer's hole card.
+ * @result: Where to store the player's result in half bets.
+ *
+ * Return: 0 on success, -1 if the shoe ran dry.
+ */
+static int play_out(const IndexConfig *config, struct hand_total player,
+		    int upcard, _Bool hit, struct future *future, int *result)
+{
+	int position = 1; // Position 0 is the dealer's hole card
+	int up_value = upcard == 0 ? 11 : upcard + 1;
+	_Bool soft;
+	int score = hand_score(&player, &soft);
+	while (hit && score > 0) {
+		int rank = future_card(future, position++);
+		if (rank < 0)
+			return -1;
+		add_card(&player, rank);
+		score = hand_score(&player, &soft);
+		int total = soft ? player.hard + 10 : player.hard;
+		hit = score > 0 && total < 21 &&
+		      blackjack_strategy(total, soft, up_value) == 'h';
+	}
+	if (score == 0) {
+		*result = -2; // A bust loses before the dealer plays
+		return 0;
+	}
+
+	struct hand_total dealer = { 0 };
+	add_card(&dealer, upcard);
+	int hole = future_card(future, 0);
+	if (hole < 0)
+		return -1;
+	add_card(&dealer, hole);
+	int dealer_score = hand_score(&dealer, &soft);
+	while (dealer_score > 0 &&
+	       (dealer_score < 17 ||
+		(config->hit_soft_17 && dealer_score == 17 && soft))) {
+		int rank = future_card(future, position++);
+		if (rank < 0)
+			return -1;
+		add_card(&dealer, rank);
+		dealer_score = hand_score(&dealer, &soft);
+	}
+	*result = blackjack_net(score, dealer_score);
+	return 0;
+}
+
+/*
+ * play_cards - Representative cards for a play.
+ * @play: Play to represent.
+ * @cards: Where to store the rank classes of the player's two cards.
+ *
+ * Soft hands are an ace and a kicker, hard 12 and up a ten and a kicker and
+ * lower hard totals a two and a kicker.
+ *
+ * Return: 0 on success, -1 if the play cannot be held with two cards.
+ */
+static int play_cards(const IndexPlay *play, int *cards)
+{
+	if (play->upcard < 2 || play->upcard > 11)
+		return -1;
+	if (play->soft) {
+		if (play->total < 12 || play->total > 20)
+			return -1;
+		cards[0] = 0;
+		cards[1] = play->total - 12;
+	} else if (play->total >= 12 && play->total <= 20) {
+		cards[0] = 9;
+		cards[1] = play->total - 11;
+	} else if (play->total >= 4 && play->total < 12) {
+		cards[0] = 1;
+		cards[1] = play->total - 3;
+	} else {
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * run_trial - Simulate one trial of a play with both decisions.
+ * @config: Configuration of the search.
+ * @play: Play to simulate.
+ * @trial: Index of the trial, selects its random stream.
+ * @bin: Where to store the true count bin of the trial.
+ * @gain: Where to store the stick result minus the hit result.
+ *
+ * The trial deals a random number of cards from the shoe, up to the
+ * penetration, then plays the decision both ways on the same future cards.
+ * Every play uses the same stream for the same trial, so plays are compared
+ * on common random numbers too.
+ *
+ * Return: 0 on success, -1 if the trial ran the shoe dry and must be skipped.
+ */
+static int run_trial(const IndexConfig *config, const IndexPlay *play,
+		     size_t trial, int *bin, int *gain)
+{
+	Rng rng;
+	rng_seed(&rng, config->seed, trial);
+	struct future future = { .rng = &rng };
+	exact_shoe(config->packs, future.shoe);
+	future.total = STANDARD_DECK_SIZE * (unsigned)config->packs;
+
+	int cards[BLACKJACK_INITIAL_DEAL];
+	play_cards(play, cards);
+	int upcard = play->upcard == 11 ? 0 : play->upcard - 1;
+	int removed[] = { cards[0], cards[1], upcard };
+	int running = 0;
+	for (size_t i = 0; i < sizeof(removed) / sizeof(removed[0]); i++) {
+		if (future.shoe[removed[i]] == 0)
+			return -1;
+		future.shoe[removed[i]]--;
+		future.total--;
+		running += hilo_tag(removed[i]);
+	}
+	unsigned reach = (unsigned)(config->penetration * future.total);
+	if (reach + MAX_FUTURE > future.total)
+		reach = future.total > MAX_FUTURE ? future.total - MAX_FUTURE : 0;
+	unsigned depth = rng_bounded(&rng, reach + 1);
+	for (unsigned i = 0; i < depth; i++)
+		running += hilo_tag(draw(future.shoe, &future.total, &rng));
+
+	double decks = (double)future.total / STANDARD_DECK_SIZE;
+	*bin = count_bin(running / decks);
+
+	struct hand_total player = { 0 };
+	add_card(&player, cards[0]);
+	add_card(&player, cards[1]);
+	int stick, hit;
+	if (play_out(config, player, upcard, 0, &future, &stick) < 0 ||
+	    play_out(config, player, upcard, 1, &future, &hit) < 0)
+		return -1;
+	*gain = stick - hit;
+	return 0;
+}
+
+/*
+ * index_finish - Free a thread of an index search.
+ * @arg: Pointer to the struct index_job.
+ * @local: Pointer to the thread's struct index_local.
+ */
+static void index_finish(void *arg, void *local)
+{
+	(void)arg;
+	struct index_local *thread = local;
+	free(thread->trials);
+	free(thread->gain);
+	free(thread);
+}
+
+/*
+ * index_start - Set up a thread of an index search.
+ * @arg: Pointer to the struct index_job.
+ *
+ * Return: Pointer to the thread's struct index_local, or NULL on error with
+ * errno set.
+ */
+static void *index_start(void *arg)
+{
+	const struct index_job *job = arg;
+	struct index_local *local = malloc(sizeof(*local));
+	if (local == NULL) {
+		errno = ENOMEM;
+		return NULL;
+	}
+	local->trials = calloc(job->num_plays, sizeof(*local->trials));
+	local->gain = calloc(job->num_plays, sizeof(*local->gain));
+	if (local->trials == NULL || local->gain == NULL) {
+		index_finish(arg, local);
+		errno = ENOMEM;
+		return NULL;
+	}
+	return local;
+}
+
+/*
+ * index_item - Run one block of trials on a thread.
+ * @arg: Pointer to the struct index_job.
+ * @local: Pointer to the thread's struct index_local.
+ * @block: Index of the block.
+ *
+ * Return: 0.
+ */
+static int index_item(void *arg, void *local, size_t block)
+{
+	const struct index_job *job = arg;
+	const IndexConfig *config = job->config;
+	struct index_local *thread = local;
+	size_t first = block * TRIAL_BLOCK;
+	size_t last = first + TRIAL_BLOCK;
+	if (last > config->trials)
+		last = config->trials;
+	for (size_t i = 0; i < job->num_plays; i++) {
+		for (size_t trial = first; trial < last; trial++) {
+			int bin, diff;
+			if (run_trial(config, &job->plays[i], trial, &bin,
+				      &diff) < 0)
+				continue;
+			thread->trials[i][bin]++;
+			thread->gain[i][bin] += diff;
+		}
+	}
+	return 0;
+}
+
+/*
+ * index_gather - Merge a thread's tallies into the plays' bins.
+ * @arg: Pointer to the struct index_job.
+ * @local: Pointer to the thread's struct index_local.
+ *
+ * The tallies are integers, so the result does not depend on the merge
+ * order.
+ */
+static void index_gather(void *arg, void *local)
+{
+	const struct index_job *job = arg;
+	const struct index_local *thread = local;
+	for (size_t i = 0; i < job->num_plays; i++) {
+		for (int bin = 0; bin < COUNT_BINS; bin++) {
+			job->plays[i].trials[bin] += thread->trials[i][bin];
+			job->plays[i].gain[bin] += thread->gain[i][bin];
+		}
+	}
+}
+
+/*
+ * find_index - Find where the better play flips between two count bins.
+ * @play: Play with its bins filled.
+ *
+ * Bins with too few trials to be meaningful are ignored. Among neighbouring
+ * meaningful bins whose mean gain changes sign, the pair with the most
+ * trials wins and the index is interpolated linearly between them.
+ */
+static void find_index(IndexPlay *play)
+{
+	uint64_t most = 0;
+	for (int bin = 0; bin < COUNT_BINS; bin++) {
+		if (play->trials[bin] > most)
+			most = play->trials[bin];
+	}
+	play->index = NAN;
+	play->stick_above = 0;
+	uint64_t best = 0;
+	int previous = -1;
+	for (int bin = 0; bin < COUNT_BINS; bin++) {
+		if (play->trials[bin] * MIN_BIN_SHARE < most ||
+		    play->trials[bin] == 0)
+			continue;
+		if (previous >= 0) {
+			double low = (double)play->gain[previous] /
+				     play->trials[previous];
+			double high = (double)play->gain[bin] / play->trials[bin];
+			uint64_t weight = play->trials[previous] +
+					  play->trials[bin];
+			if ((low < 0) != (high < 0) && weight > best) {
+				best = weight;
+				double at = previous + (bin - previous) *
+					    (low / (low - high));
+				play->index = COUNT_MIN_TC + at;
+				play->stick_above = high > low;
+			}
+		}
+		previous = bin;
+	}
+}
+
+/*
+ * index_generate - Find the true count index of each play.
+ * @config: Configuration of the search.
+ * @plays: Plays to search, with their total, softness and upcard set.
+ * @num_plays: Number of plays.
+ *
+ * Simulates @config->trials decisions per play at random depths of the
+ * shoe, each played both ways on the same cards, and bins the difference by
+ * the Hi-Lo true count at the decision. The index is where the mean
+ * difference changes sign. Trial blocks are shared between
+ * @config->threads threads and the result does not depend on their number.
+ *
+ * Return: 0 on success, -1 on error with errno set.
+ */
+int index_generate(const IndexConfig *config, IndexPlay *plays,
+		   size_t num_plays)
+{
+	if (config == NULL || config->packs < 1 || config->penetration < 0.0 ||
+	    config->penetration > 1.0 || (plays == NULL && num_plays > 0)) {
+		errno = EINVAL;
+		return -1;
+	}
+	for (size_t i = 0; i < num_plays; i++) {
+		int cards[BLACKJACK_INITIAL_DEAL];
+		if (play_cards(&plays[i], cards) < 0) {
+			errno = EINVAL;
+			return -1;
+		}
+		memset(plays[i].trials, 0, sizeof(plays[i].trials));
+		memset(plays[i].gain, 0, sizeof(plays[i].gain));
+	}
+	struct index_job job = {
+		.config = config,
+		.plays = plays,
+		.num_plays = num_plays,
+	};
+	PoolTask task = {
+		.items = (config->trials + TRIAL_BLOCK - 1) / TRIAL_BLOCK,
+		.threads = config->threads,
+		.arg = &job,
+		.start = index_start,
+		.item = index_item,
+		.merge = index_gather,
+		.finish = index_finish,
+	};
+	if (pool_run(&task) < 0)
+		return -1;
+	for (size_t i = 0; i < num_plays; i++)
+		find_index(&plays[i]);
+	return 0;
+}
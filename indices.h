@@ -0,0 +1,56 @@
+#ifndef INDICES_H
+#define INDICES_H
+
+#include <stddef.h> // provides size_t
+#include <stdint.h> // provides uint64_t
+#include "cards.h"
+
+/*
+ * struct index_config - Parameters of an index play search.
+ * @packs: Number of packs in the shoe.
+ * @hit_soft_17: If the dealer hits soft 17.
+ * @penetration: Deepest fraction of the shoe dealt before a decision.
+ * @seed: Seed of the search.
+ * @trials: Number of simulated decisions for each play.
+ * @threads: Number of threads to run the trials on.
+ */
+typedef struct index_config {
+	int packs;
+	_Bool hit_soft_17;
+	double penetration;
+	uint64_t seed;
+	size_t trials;
+	int threads;
+} IndexConfig;
+
+/*
+ * struct index_play - A hit or stick decision and its index.
+ * @total: Player's total, 4 to 20.
+ * @soft: If the player's hand is soft.
+ * @upcard: blackjack_value() of the dealer's upcard (2 to 11).
+ * @trials: Trials that landed in each true count bin.
+ * @gain: Sum over each bin's trials of the stick result minus the hit
+ *        result, in half bets.
+ * @index: True count at and above which sticking beats hitting, or below
+ *         which it does if @stick_above is not set. NaN if the better play
+ *         never changes over the binned counts.
+ * @stick_above: If sticking is the better play above @index.
+ *
+ * The first three members are filled by the caller, the rest by
+ * index_generate(). Bin i holds Hi-Lo true count COUNT_MIN_TC + i.
+ */
+typedef struct index_play {
+	int total;
+	_Bool soft;
+	int upcard;
+	uint64_t trials[COUNT_BINS];
+	int64_t gain[COUNT_BINS];
+	double index;
+	_Bool stick_above;
+} IndexPlay;
+
+/* Function prototypes. */
+int index_generate(const IndexConfig *config, IndexPlay *plays,
+		   size_t num_plays);
+
+#endif // INDICES_H
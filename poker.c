@@ -0,0 +1,663 @@
+/*
+ * poker.c - Table driven poker hand evaluation.
+ */
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 199309L // provides clock_gettime()
+#endif
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "poker.h"
+
+#define POKER_MAX_CARDS 7
+#define POKER_RANKS 13
+#define LO_RANKS 7 // Deuce to eight, keyed in the low quinary field
+#define HI_RANKS 6 // Nine to ace, keyed in the high quinary field
+#define LO_KEYS 78125 // 5^LO_RANKS
+#define HI_KEYS 15625 // 5^HI_RANKS
+#define LO_MASK 0x1FFFF // LO_KEYS fits in 17 bits
+#define HI_SHIFT 17
+#define HI_MASK 0x3FFF // HI_KEYS fits in 14 bits
+#define SUIT_SHIFT 32 // Four 4-bit suit counters start here
+#define SUIT_BIAS 0x3333 // Makes bit 3 of a counter flag 5 or more cards
+#define SUIT_FLAGS 0x8888
+#define FLUSH_KEYS 8192 // Every mask of one suit
+#define SCORE_SHIFT 20 // Category bits of a raw score
+#define POKER_TABLE_MAGIC "CCPOKER"
+#define POKER_TABLE_VERSION 1
+
+/*
+ * struct multiset - A multiset of ranks from one quinary field.
+ * @key: Quinary key of the multiset, the count of rank i in digit i.
+ * @size: Number of cards in the multiset.
+ */
+struct multiset {
+	uint32_t key;
+	int size;
+};
+
+/*
+ * struct poker_tables - Lookup tables of the evaluator.
+ * @card_keys: Key of each card, indexed by its CardSet bit.
+ * @lo_base: Offset into @ranks of each low quinary key.
+ * @hi_index: Index of each high quinary key among the high multisets,
+ *            ordered by size.
+ * @flush: Value of each suit mask holding five or more cards.
+ * @category_first: Lowest value of each category.
+ * @ranks: Value of every non-flush hand of up to seven cards.
+ * @num_ranks: Number of entries in @ranks.
+ *
+ * The members point into one payload, laid out as a table file stores it:
+ * @num_ranks as a uint64_t followed by each array in the order above, so
+ * every array is aligned for its type.
+ */
+struct poker_tables {
+	const PokerKey *card_keys;
+	const uint32_t *lo_base;
+	const uint16_t *hi_index;
+	const uint16_t *flush;
+	const uint16_t *category_first;
+	const uint16_t *ranks;
+	size_t num_ranks;
+};
+
+static struct poker_tables tables;
+static pthread_mutex_t tables_lock = PTHREAD_MUTEX_INITIALIZER;
+static const void *tables_payload; // Built or mapped payload, NULL until ready
+static atomic_bool tables_ready; // Set with release ordering once attached
+static size_t tables_size; // Size of the payload in bytes
+
+/*
+ * enumerate - Collect every multiset of a field's ranks up to seven cards.
+ * @ranks: Number of ranks in the field.
+ * @sets: Where to store the multisets, ordered by size.
+ *
+ * Return: Number of multisets stored.
+ */
+static size_t enumerate(int ranks, struct multiset *sets)
+{
+	size_t count = 0;
+	uint32_t keys = 1;
+	for (int i = 0; i < ranks; i++)
+		keys *= 5;
+	for (int size = 0; size <= POKER_MAX_CARDS; size++) {
+		for (uint32_t key = 0; key < keys; key++) {
+			int cards = 0;
+			for (uint32_t rest = key; rest > 0; rest /= 5)
+				cards += rest % 5;
+			if (cards == size)
+				sets[count++] = (struct multiset){ key, size };
+		}
+	}
+	return count;
+}
+
+/*
+ * straight_high - Find the best straight in a mask of ranks.
+ * @mask: Ranks held, bit 0 for deuces through bit 12 for aces.
+ *
+ * Return: Rank of the straight's top card, 3 for the wheel, or -1 if none.
+ */
+static int straight_high(unsigned mask)
+{
+	for (int high = POKER_RANKS - 1; high >= 4; high--) {
+		if (((mask >> (high - 4)) & 0x1F) == 0x1F)
+			return high;
+	}
+	if ((mask & 0x100F) == 0x100F)
+		return 3; // Ace plays low in the wheel
+	return -1;
+}
+
+/*
+ * pack_score - Pack a category and up to five ranks into a raw score.
+ * @category: Category of the hand.
+ * @ranks: Ranks deciding the hand within its category, most significant
+ *         first.
+ * @count: Number of ranks, up to five.
+ *
+ * Return: Score that compares like the hands it represents.
+ */
+static uint32_t pack_score(PokerCategory category, const int *ranks, int count)
+{
+	uint32_t score = (uint32_t)category << SCORE_SHIFT;
+	for (int i = 0; i < count; i++)
+		score |= (uint32_t)ranks[i] << (16 - 4 * i);
+	return score;
+}
+
+/*
+ * score_counts - Raw score of the best non-flush hand from rank counts.
+ * @counts: Cards held of each rank, deuce first.
+ *
+ * Return: Score of the best five cards.
+ */
+static uint32_t score_counts(const int *counts)
+{
+	int quads = -1, trips[2], pairs[3], singles[POKER_MAX_CARDS];
+	int num_trips = 0, num_pairs = 0, num_singles = 0;
+	unsigned mask = 0;
+	for (int rank = POKER_RANKS - 1; rank >= 0; rank--) {
+		if (counts[rank] > 0)
+			mask |= 1U << rank;
+		if (counts[rank] == 4)
+			quads = rank;
+		else if (counts[rank] == 3)
+			trips[num_trips++] = rank;
+		else if (counts[rank] == 2)
+			pairs[num_pairs++] = rank;
+		else if (counts[rank] == 1)
+			singles[num_singles++] = rank;
+	}
+	int ranks[5];
+	if (quads >= 0) {
+		ranks[0] = quads;
+		ranks[1] = 31 - __builtin_clz(mask & ~(1U << quads));
+		return pack_score(FOUR_OF_A_KIND, ranks, 2);
+	}
+	if (num_trips > 0 && num_trips + num_pairs > 1) {
+		ranks[0] = trips[0];
+		ranks[1] = num_pairs > 0 ? pairs[0] : -1;
+		if (num_trips > 1 && trips[1] > ranks[1])
+			ranks[1] = trips[1];
+		return pack_score(FULL_HOUSE, ranks, 2);
+	}
+	int high = straight_high(mask);
+	if (high >= 0)
+		return pack_score(STRAIGHT, &high, 1);
+	if (num_trips > 0) {
+		ranks[0] = trips[0];
+		memcpy(&ranks[1], singles, 2 * sizeof(int));
+		return pack_score(THREE_OF_A_KIND, ranks, 3);
+	}
+	if (num_pairs > 1) {
+		ranks[0] = pairs[0];
+		ranks[1] = pairs[1];
+		ranks[2] = num_singles > 0 ? singles[0] : -1;
+		if (num_pairs > 2 && pairs[2] > ranks[2])
+			ranks[2] = pairs[2];
+		return pack_score(TWO_PAIR, ranks, 3);
+	}
+	if (num_pairs > 0) {
+		ranks[0] = pairs[0];
+		memcpy(&ranks[1], singles, 3 * sizeof(int));
+		return pack_score(ONE_PAIR, ranks, 4);
+	}
+	return pack_score(HIGH_CARD, singles, 5);
+}
+
+/*
+ * score_flush - Raw score of the best hand in one suit.
+ * @suit_mask: Mask of the suit as cardset_suit() returns it.
+ *
+ * Return: Score of the best flush or straight flush, or 0 for fewer than
+ * five cards.
+ */
+static uint32_t score_flush(unsigned suit_mask)
+{
+	if (__builtin_popcount(suit_mask) < 5)
+		return 0;
+	unsigned mask = (suit_mask >> 1) | ((suit_mask & 1) << 12); // Ace high
+	int high = straight_high(mask);
+	if (high >= 0)
+		return pack_score(STRAIGHT_FLUSH, &high, 1);
+	int ranks[5];
+	for (int i = 0; i < 5; i++) {
+		ranks[i] = 31 - __builtin_clz(mask);
+		mask &= ~(1U << ranks[i]);
+	}
+	return pack_score(FLUSH, ranks, 5);
+}
+
+/*
+ * compare_scores - qsort() comparator for raw scores.
+ * @a: First score.
+ * @b: Second score.
+ *
+ * Return: Negative, zero or positive as @a is below, equal to or above @b.
+ */
+static int compare_scores(const void *a, const void *b)
+{
+	uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+	return (x > y) - (x < y);
+}
+
+/*
+ * score_value - Map a raw score to its value.
+ * @classes: Sorted distinct raw scores of every hand class.
+ * @score: Raw score, 0 for no hand.
+ *
+ * Return: Position of @score among @classes plus one, or 0 for no hand.
+ */
+static uint16_t score_value(const uint32_t *classes, uint32_t score)
+{
+	if (score == 0)
+		return 0;
+	const uint32_t *found = bsearch(&score, classes, POKER_CLASSES,
+					sizeof(*classes), compare_scores);
+	return (uint16_t)(found - classes + 1);
+}
+
+/*
+ * decode - Add the rank counts of a quinary key to a count array.
+ * @key: Quinary key.
+ * @counts: Counts of the field's ranks, starting with its lowest rank.
+ * @ranks: Number of ranks in the field.
+ */
+static void decode(uint32_t key, int *counts, int ranks)
+{
+	for (int i = 0; i < ranks; i++, key /= 5)
+		counts[i] = (int)(key % 5);
+}
+
+/*
+ * payload_size - Size of a table payload.
+ * @num_ranks: Number of entries in the rank table.
+ *
+ * Return: Size of the payload in bytes.
+ */
+static size_t payload_size(size_t num_ranks)
+{
+	return sizeof(uint64_t) + STANDARD_DECK_SIZE * sizeof(PokerKey) +
+	       LO_KEYS * sizeof(uint32_t) +
+	       (HI_KEYS + FLUSH_KEYS + STRAIGHT_FLUSH + 1 + num_ranks) *
+		       sizeof(uint16_t);
+}
+
+/*
+ * attach_tables - Point the tables at a payload.
+ * @payload: Payload built by build_tables() or mapped from a table file.
+ * @size: Size of @payload in bytes.
+ *
+ * Return: 0 on success, -1 with errno set to EBADMSG if @size does not match
+ * the rank count the payload records.
+ */
+static int attach_tables(const void *payload, size_t size)
+{
+	uint64_t num_ranks;
+	if (size < sizeof(num_ranks)) {
+		errno = EBADMSG;
+		return -1;
+	}
+	memcpy(&num_ranks, payload, sizeof(num_ranks));
+	if (num_ranks > size || payload_size(num_ranks) != size) {
+		errno = EBADMSG;
+		return -1;
+	}
+	const unsigned char *ptr = (const unsigned char *)payload +
+				   sizeof(num_ranks);
+	tables.card_keys = (const void *)ptr;
+	ptr += STANDARD_DECK_SIZE * sizeof(PokerKey);
+	tables.lo_base = (const void *)ptr;
+	ptr += LO_KEYS * sizeof(uint32_t);
+	tables.hi_index = (const void *)ptr;
+	ptr += HI_KEYS * sizeof(uint16_t);
+	tables.flush = (const void *)ptr;
+	ptr += FLUSH_KEYS * sizeof(uint16_t);
+	tables.category_first = (const void *)ptr;
+	ptr += (STRAIGHT_FLUSH + 1) * sizeof(uint16_t);
+	tables.ranks = (const void *)ptr;
+	tables.num_ranks = num_ranks;
+	tables_payload = payload;
+	tables_size = size;
+	return 0;
+}
+
+/*
+ * build_tables - Build the evaluator's tables.
+ *
+ * Every multiset of low ranks gets a block of the rank table holding the high
+ * multisets that fit beside it, which are ordered by size so the block is a
+ * prefix of them. Raw scores of every hand are then ranked among the
+ * POKER_CLASSES distinct five-card hands. Called with @tables_lock held.
+ *
+ * Return: 0 on success, -1 on error with errno set, with every table pointer
+ * reset to NULL.
+ */
+static int build_tables(void)
+{
+	int ret = -1;
+	struct multiset *lo = malloc(LO_KEYS * sizeof(*lo));
+	struct multiset *hi = malloc(HI_KEYS * sizeof(*hi));
+	uint32_t *scores = NULL, *classes = NULL;
+	unsigned char *payload = NULL;
+	if (lo == NULL || hi == NULL)
+		goto nomem;
+	size_t num_lo = enumerate(LO_RANKS, lo);
+	size_t num_hi = enumerate(HI_RANKS, hi);
+	size_t fits[POKER_MAX_CARDS + 1] = { 0 }; // High multisets of <= n cards
+	for (size_t i = 0; i < num_hi; i++) {
+		for (int n = hi[i].size; n <= POKER_MAX_CARDS; n++)
+			fits[n]++;
+	}
+	size_t total = 0;
+	for (size_t i = 0; i < num_lo; i++)
+		total += fits[POKER_MAX_CARDS - lo[i].size];
+	size_t size = payload_size(total);
+	payload = calloc(1, size);
+	scores = malloc((total + FLUSH_KEYS) * sizeof(*scores));
+	classes = malloc((total + FLUSH_KEYS) * sizeof(*classes));
+	if (payload == NULL || scores == NULL || classes == NULL)
+		goto nomem;
+	uint64_t num_ranks = total;
+	memcpy(payload, &num_ranks, sizeof(num_ranks));
+	attach_tables(payload, size);
+	PokerKey *card_keys = (PokerKey *)tables.card_keys;
+	uint32_t *lo_base = (uint32_t *)tables.lo_base;
+	uint16_t *hi_index = (uint16_t *)tables.hi_index;
+	uint16_t *flush = (uint16_t *)tables.flush;
+	uint16_t *category_first = (uint16_t *)tables.category_first;
+	uint16_t *ranks = (uint16_t *)tables.ranks;
+	tables_payload = NULL; // Not ready until filled
+
+	for (size_t i = 0; i < num_hi; i++)
+		hi_index[hi[i].key] = (uint16_t)i;
+	for (size_t i = 0, base = 0; i < num_lo; i++) {
+		lo_base[lo[i].key] = (uint32_t)base;
+		base += fits[POKER_MAX_CARDS - lo[i].size];
+	}
+	for (size_t i = 0; i < num_lo; i++) {
+		int counts[POKER_RANKS];
+		decode(lo[i].key, counts, LO_RANKS);
+		size_t base = lo_base[lo[i].key];
+		for (size_t j = 0; j < fits[POKER_MAX_CARDS - lo[i].size]; j++) {
+			decode(hi[j].key, &counts[LO_RANKS], HI_RANKS);
+			scores[base + j] = lo[i].size + hi[j].size < 5 ?
+						   0 : score_counts(counts);
+		}
+	}
+	for (unsigned mask = 0; mask < FLUSH_KEYS; mask++)
+		scores[total + mask] = score_flush(mask);
+
+	size_t num_classes = 0;
+	for (size_t i = 0; i < total + FLUSH_KEYS; i++) {
+		if (scores[i] != 0)
+			classes[num_classes++] = scores[i];
+	}
+	qsort(classes, num_classes, sizeof(*classes), compare_scores);
+	size_t distinct = 0;
+	for (size_t i = 0; i < num_classes; i++) {
+		if (distinct == 0 || classes[i] != classes[distinct - 1])
+			classes[distinct++] = classes[i];
+	}
+	if (distinct != POKER_CLASSES) {
+		errno = EPROTO; // The scoring above is broken
+		goto out;
+	}
+	for (size_t i = 0; i < total; i++)
+		ranks[i] = score_value(classes, scores[i]);
+	for (unsigned mask = 0; mask < FLUSH_KEYS; mask++)
+		flush[mask] = score_value(classes, scores[total + mask]);
+	for (size_t i = POKER_CLASSES; i-- > 0;)
+		category_first[classes[i] >> SCORE_SHIFT] = (uint16_t)(i + 1);
+
+	static const uint32_t powers[] = { 1, 5, 25, 125, 625, 3125, 15625 };
+	for (int bit = 0; bit < STANDARD_DECK_SIZE; bit++) {
+		int rank = (bit % 13 + 12) % 13; // Deuce 0 through ace 12
+		PokerKey key = rank < LO_RANKS ?
+			powers[rank] : (PokerKey)powers[rank - LO_RANKS] << HI_SHIFT;
+		card_keys[bit] = key +
+			((PokerKey)1 << (SUIT_SHIFT + 4 * (bit / 13)));
+	}
+	tables_payload = payload;
+	payload = NULL;
+	ret = 0;
+	goto out;
+nomem:
+	errno = ENOMEM;
+out:
+	if (ret < 0)
+		tables = (struct poker_tables){ 0 }; // Don't point into @payload
+	free(lo);
+	free(hi);
+	free(scores);
+	free(classes);
+	free(payload);
+	return ret;
+}
+
+/*
+ * poker_init - Build the evaluator's lookup tables.
+ *
+ * Must be called, or poker_init_file(), before poker_key(), poker_rank() or
+ * poker_eval(). Later calls, from any thread, return at once without
+ * taking @tables_lock, so evaluators can call it for every hand.
+ *
+ * Return: 0 on success, -1 on error with errno set.
+ */
+int poker_init(void)
+{
+	if (atomic_load_explicit(&tables_ready, memory_order_acquire))
+		return 0;
+	pthread_mutex_lock(&tables_lock);
+	int ret = tables_payload != NULL ? 0 : build_tables();
+	if (ret == 0)
+		atomic_store_explicit(&tables_ready, 1, memory_order_release);
+	pthread_mutex_unlock(&tables_lock);
+	return ret;
+}
+
+/*
+ * poker_init_file - Load the evaluator's tables from a table file.
+ * @path: Path of the table file.
+ *
+ * Maps the file with table_map(), so processes loading the same file share
+ * its pages and start in about a millisecond. If the file is missing, stale
+ * or corrupt, the tables are built as poker_init() builds them and written
+ * to @path for the next process. Failing to write the file is not an error.
+ *
+ * Return: 0 on success, -1 on error with errno set.
+ */
+int poker_init_file(const char *path)
+{
+	if (path == NULL) {
+		errno = EINVAL;
+		return -1;
+	}
+	if (atomic_load_explicit(&tables_ready, memory_order_acquire))
+		return 0;
+	pthread_mutex_lock(&tables_lock);
+	int ret = 0;
+	if (tables_payload == NULL) {
+		size_t size;
+		const void *payload = table_map(path, POKER_TABLE_MAGIC,
+						POKER_TABLE_VERSION, &size);
+		if (payload != NULL && attach_tables(payload, size) < 0) {
+			table_unmap(payload, size);
+			payload = NULL;
+		}
+		if (payload == NULL) {
+			int saved = errno;
+			ret = build_tables();
+			if (ret == 0)
+				table_write(path, POKER_TABLE_MAGIC,
+					    POKER_TABLE_VERSION, tables_payload,
+					    tables_size);
+			else
+				saved = errno;
+			errno = saved;
+		}
+	}
+	if (ret == 0)
+		atomic_store_explicit(&tables_ready, 1, memory_order_release);
+	pthread_mutex_unlock(&tables_lock);
+	return ret;
+}
+
+/*
+ * poker_save - Write the evaluator's tables to a table file.
+ * @path: Path of the file to write.
+ *
+ * Builds the tables first if needed. The file can be loaded with
+ * poker_init_file().
+ *
+ * Return: 0 on success, -1 on error with errno set.
+ */
+int poker_save(const char *path)
+{
+	if (poker_init() < 0)
+		return -1;
+	return table_write(path, POKER_TABLE_MAGIC, POKER_TABLE_VERSION,
+			   tables_payload, tables_size);
+}
+
+/*
+ * poker_key - Key of a set of cards.
+ * @set: Cards to key.
+ *
+ * Return: Sum of the keys of the cards of @set.
+ */
+PokerKey poker_key(CardSet set)
+{
+	PokerKey key = 0;
+	for (set &= CARDSET_FULL; set != CARDSET_EMPTY; set &= set - 1)
+		key += tables.card_keys[__builtin_ctzll(set)];
+	return key;
+}
+
+/*
+ * poker_rank - Value of the best poker hand in five to seven cards.
+ * @key: poker_key() of the cards.
+ * @set: The cards themselves.
+ *
+ * A set of up to seven cards holds at most one flush, and a flush beats
+ * anything else such a set can make, so the suit counters in @key decide
+ * between the flush table and the rank table. Either way the value is one
+ * or three table loads with no sorting.
+ *
+ * Return: Value from 1 for the worst high card to POKER_CLASSES for a royal
+ * flush, comparable between hands. Sets of fewer than five cards give 0.
+ */
+uint16_t poker_rank(PokerKey key, CardSet set)
+{
+	PokerKey flushes = ((key >> SUIT_SHIFT) + SUIT_BIAS) & SUIT_FLAGS;
+	if (flushes != 0) {
+		int suit = __builtin_ctzll(flushes) >> 2;
+		return tables.flush[cardset_suit(set, (Suit)suit)];
+	}
+	return tables.ranks[tables.lo_base[key & LO_MASK] +
+			    tables.hi_index[(key >> HI_SHIFT) & HI_MASK]];
+}
+
+/*
+ * poker_eval - Value of the best poker hand in a set of cards.
+ * @set: Five to seven cards.
+ *
+ * Return: Value as poker_rank() returns it, 0 for sets of the wrong size.
+ */
+uint16_t poker_eval(CardSet set)
+{
+	int size = cardset_size(set & CARDSET_FULL);
+	if (size < 5 || size > POKER_MAX_CARDS)
+		return 0;
+	return poker_rank(poker_key(set), set);
+}
+
+/*
+ * poker_eval_hand - Value of the best poker hand in a hand of cards.
+ * @hand: Hand of five to seven distinct cards.
+ *
+ * Builds the tables on first use.
+ *
+ * Return: Value as poker_rank() returns it, or -1 on error with errno set.
+ */
+int poker_eval_hand(const Hand *hand)
+{
+	CardSet set;
+	if (poker_init() < 0 || hand_cardset(hand, &set) < 0)
+		return -1;
+	uint16_t value = poker_eval(set);
+	if (value == 0) {
+		errno = EINVAL;
+		return -1;
+	}
+	return value;
+}
+
+/*
+ * poker_category - Category of a hand value.
+ * @value: Value from poker_rank(), greater than 0.
+ *
+ * Return: Category of the hand.
+ */
+PokerCategory poker_category(uint16_t value)
+{
+	PokerCategory category = STRAIGHT_FLUSH;
+	while (category > HIGH_CARD && value < tables.category_first[category])
+		category--;
+	return category;
+}
+
+/*
+ * poker_bench - Evaluate every seven-card hand and report the rate.
+ * @out: Stream to print the results to.
+ *
+ * Enumerates all 133,784,560 seven-card hands on the calling thread, adding
+ * card keys incrementally as a board enumeration would, and prints the
+ * number of hands in each category alongside the hands evaluated per second.
+ *
+ * Return: 0 on success, -1 on error with errno set.
+ */
+int poker_bench(FILE *out)
+{
+	static const char *const names[] = {
+		"high card", "one pair", "two pair", "three of a kind",
+		"straight", "flush", "full house", "four of a kind",
+		"straight flush"
+	};
+	if (out == NULL) {
+		errno = EINVAL;
+		return -1;
+	}
+	if (poker_init() < 0)
+		return -1;
+	const PokerKey *keys = tables.card_keys;
+	uint64_t counts[POKER_CLASSES + 1] = { 0 };
+	struct timespec start, end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (int a = 0; a < 46; a++) {
+		for (int b = a + 1; b < 47; b++) {
+			PokerKey kb = keys[a] + keys[b];
+			CardSet sb = (CardSet)1 << a | (CardSet)1 << b;
+			for (int c = b + 1; c < 48; c++) {
+				PokerKey kc = kb + keys[c];
+				CardSet sc = sb | (CardSet)1 << c;
+				for (int d = c + 1; d < 49; d++) {
+					PokerKey kd = kc + keys[d];
+					CardSet sd = sc | (CardSet)1 << d;
+					for (int e = d + 1; e < 50; e++) {
+						PokerKey ke = kd + keys[e];
+						CardSet se = sd | (CardSet)1 << e;
+						for (int f = e + 1; f < 51; f++) {
+							PokerKey kf = ke + keys[f];
+							CardSet sf = se |
+								     (CardSet)1 << f;
+							for (int g = f + 1; g < 52; g++)
+								counts[poker_rank(
+									kf + keys[g],
+									sf | (CardSet)1 << g)]++;
+						}
+					}
+				}
+			}
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	double seconds = (double)(end.tv_sec - start.tv_sec) +
+			 (double)(end.tv_nsec - start.tv_nsec) / 1e9;
+	uint64_t categories[STRAIGHT_FLUSH + 1] = { 0 }, hands = 0;
+	for (int value = 1; value <= POKER_CLASSES; value++) {
+		categories[poker_category((uint16_t)value)] += counts[value];
+		hands += counts[value];
+	}
+	for (int category = STRAIGHT_FLUSH; category >= HIGH_CARD; category--)
+		fprintf(out, "%-16s %12llu\n", names[category],
+			(unsigned long long)categories[category]);
+	fprintf(out, "%-16s %12llu\n", "total", (unsigned long long)hands);
+	fprintf(out, "%.3f seconds, %.0f hands/s\n", seconds,
+		(double)hands / seconds);
+	return 0;
+}
@@ -0,0 +1,42 @@
+#ifndef POKER_H
+#define POKER_H
+
+#include <stdint.h> // provides uint16_t, uint64_t
+#include <stdio.h> // provides FILE
+#include "cards.h"
+#include "cardset.h"
+
+#define POKER_CLASSES 7462 // Distinct 5-card hand values
+
+/* The categories of a poker hand, from worst to best. */
+typedef enum poker_category {
+	HIGH_CARD,
+	ONE_PAIR,
+	TWO_PAIR,
+	THREE_OF_A_KIND,
+	STRAIGHT,
+	FLUSH,
+	FULL_HOUSE,
+	FOUR_OF_A_KIND,
+	STRAIGHT_FLUSH
+} PokerCategory;
+
+/*
+ * Key of a set of cards for poker_rank(). The key of a set is the sum of the
+ * keys of its cards, so keys of disjoint sets can be added while enumerating
+ * boards rather than recomputed for every hand.
+ */
+typedef uint64_t PokerKey;
+
+/* Function prototypes. */
+int poker_init(void);
+int poker_init_file(const char *path);
+int poker_save(const char *path);
+PokerKey poker_key(CardSet set);
+uint16_t poker_rank(PokerKey key, CardSet set);
+uint16_t poker_eval(CardSet set);
+int poker_eval_hand(const Hand *hand);
+PokerCategory poker_category(uint16_t value);
+int poker_bench(FILE *out);
+
+#endif // POKER_H
@@ -0,0 +1,106 @@
+/*
+ * pool.c - Run numbered work items on a pool of threads.
+ */
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include "pool.h"
+
+/*
+ * struct pool - State shared by the threads running a task.
+ * @task: Task being run.
+ * @next: Next item to claim.
+ * @lock: Protects @error and serialises merges.
+ * @error: errno of the first failure, or 0.
+ */
+struct pool {
+	const PoolTask *task;
+	atomic_size_t next;
+	pthread_mutex_t lock;
+	int error;
+};
+
+/*
+ * pool_work - Run items of a task until none are left.
+ * @arg: Pointer to the shared struct pool.
+ *
+ * A thread that fails merges nothing and stops the others, so a failed run
+ * does not wait for the rest of its items.
+ *
+ * Return: NULL, failures are recorded in the pool.
+ */
+static void *pool_work(void *arg)
+{
+	struct pool *pool = arg;
+	const PoolTask *task = pool->task;
+	void *local = task->start(task->arg);
+	int error = 0;
+	if (local == NULL) {
+		error = errno != 0 ? errno : ENOMEM;
+	} else {
+		size_t item;
+		while ((item = atomic_fetch_add(&pool->next, 1)) <
+		       task->items) {
+			if (task->item(task->arg, local, item) < 0) {
+				error = errno;
+				break;
+			}
+		}
+	}
+	pthread_mutex_lock(&pool->lock);
+	if (error != 0 && pool->error == 0)
+		pool->error = error;
+	if (error == 0)
+		task->merge(task->arg, local);
+	pthread_mutex_unlock(&pool->lock);
+	if (error != 0)
+		atomic_store(&pool->next, task->items); // Stop the others
+	if (local != NULL)
+		task->finish(task->arg, local);
+	return NULL;
+}
+
+/*
+ * pool_run - Run every item of a task.
+ * @task: Task to run.
+ *
+ * Starts @task->threads - 1 threads and works alongside them on the calling
+ * thread, which also picks up the slack if some cannot be started.
+ *
+ * Return: 0 on success, -1 on error with errno set.
+ */
+int pool_run(const PoolTask *task)
+{
+	if (task == NULL || task->start == NULL || task->item == NULL ||
+	    task->merge == NULL || task->finish == NULL) {
+		errno = EINVAL;
+		return -1;
+	}
+	struct pool pool = { .task = task };
+	atomic_init(&pool.next, 0);
+	pthread_mutex_init(&pool.lock, NULL);
+
+	size_t count = task->threads > 1 ? (size_t)task->threads : 1;
+	pthread_t *threads = calloc(count, sizeof(*threads));
+	if (threads == NULL) {
+		pthread_mutex_destroy(&pool.lock);
+		errno = ENOMEM;
+		return -1;
+	}
+	size_t started = 0;
+	for (; started + 1 < count; started++) {
+		if (pthread_create(&threads[started], NULL, pool_work, &pool))
+			break; // The calling thread picks up the slack
+	}
+	pool_work(&pool);
+	for (size_t i = 0; i < started; i++)
+		pthread_join(threads[i], NULL);
+	free(threads);
+	pthread_mutex_destroy(&pool.lock);
+	if (pool.error != 0) {
+		errno = pool.error;
+		return -1;
+	}
+	return 0;
+}
@@ -0,0 +1,36 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <stddef.h> // provides size_t
+
+/*
+ * struct pool_task - Numbered items folded into per-thread results.
+ * @items: Number of items, numbered from 0.
+ * @threads: Number of threads, 0 or 1 to run on the calling thread.
+ * @arg: Passed to every callback, typically the run's configuration and
+ *       its total.
+ * @start: Allocate a thread's local state, or return NULL with errno set.
+ * @item: Add one item to a thread's local state, return 0 on success or -1
+ *        with errno set.
+ * @merge: Add a thread's local state to the total, called once the thread
+ *         has run out of items, one thread at a time.
+ * @finish: Free a thread's local state.
+ *
+ * Threads claim items from a shared counter and only meet again to merge,
+ * so a task whose items each depend only on their number gives the same
+ * total however many threads run it, provided merging is order free.
+ */
+typedef struct pool_task {
+	size_t items;
+	int threads;
+	void *arg;
+	void *(*start)(void *arg);
+	int (*item)(void *arg, void *local, size_t item);
+	void (*merge)(void *arg, void *local);
+	void (*finish)(void *arg, void *local);
+} PoolTask;
+
+/* Function prototypes. */
+int pool_run(const PoolTask *task);
+
+#endif // POOL_H
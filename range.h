@@ -0,0 +1,51 @@
+#ifndef RANGE_H
+#define RANGE_H
+
+#include <stddef.h> // provides size_t
+#include <stdint.h> // provides uint64_t
+#include "cardset.h"
+#include "equity.h"
+
+#define RANGE_MAX_COMBOS 1326 // Two-card combinations of one pack
+
+/*
+ * struct range_combo - A weighted combination of hole cards.
+ * @cards: The two hole cards.
+ * @weight: Relative weight of the combination, greater than 0.
+ */
+typedef struct range_combo {
+	CardSet cards;
+	double weight;
+} RangeCombo;
+
+/*
+ * struct range - A weighted range of hole cards.
+ * @num_combos: Number of combinations in the range.
+ * @combos: Each distinct combination with its weight.
+ */
+typedef struct range {
+	size_t num_combos;
+	RangeCombo combos[RANGE_MAX_COMBOS];
+} Range;
+
+/*
+ * struct range_result - Outcome of a range against range calculation.
+ * @boards: Number of boards evaluated.
+ * @exact: If every remaining board was enumerated.
+ * @weight: Summed weight of the matchups without shared cards.
+ * @equity: Expected share of the pot of each range, hero first.
+ */
+typedef struct range_result {
+	uint64_t boards;
+	_Bool exact;
+	double weight;
+	double equity[2];
+} RangeResult;
+
+/* Function prototypes. */
+int range_parse(const char *str, Range *range);
+size_t range_block(Range *range, CardSet dead);
+int range_equity(const EquityConfig *config, const Range *hero,
+		 const Range *villain, CardSet board, RangeResult *result);
+
+#endif // RANGE_H
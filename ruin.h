@@ -0,0 +1,63 @@
+#ifndef RUIN_H
+#define RUIN_H
+
+#include <stddef.h> // provides size_t
+#include <stdint.h> // provides uint64_t
+
+/*
+ * struct ruin_bin - Outcome of a unit bet at one true count.
+ * @freq: How often rounds are dealt at the count, any scale.
+ * @ev: Expected winnings of a one unit bet.
+ * @variance: Variance of the winnings of a one unit bet.
+ */
+typedef struct ruin_bin {
+	double freq;
+	double ev;
+	double variance;
+} RuinBin;
+
+/*
+ * struct ruin_config - Bankroll and bet constraints.
+ * @bankroll: Bankroll in units.
+ * @min_bet: Smallest bet allowed, 0 to sit out counts without an edge.
+ * @max_bet: Largest bet allowed.
+ * @kelly: Fraction of the Kelly bet to make, 1 for full Kelly.
+ * @rounds: Rounds played, 0 for play without end.
+ * @trials: Bankrolls played out by ruin_simulate().
+ * @seed: Seed of ruin_simulate(), trial n uses stream n.
+ */
+typedef struct ruin_config {
+	double bankroll;
+	double min_bet;
+	double max_bet;
+	double kelly;
+	size_t rounds;
+	size_t trials;
+	uint64_t seed;
+} RuinConfig;
+
+/*
+ * struct ruin_result - Risk of a bet ramp.
+ * @mean: Expected winnings per round, in units.
+ * @variance: Variance of the winnings per round.
+ * @growth: Expected log growth of the bankroll per round.
+ * @n0: Rounds for the expectation to reach one standard deviation.
+ * @ror: Probability of losing the bankroll.
+ */
+typedef struct ruin_result {
+	double mean;
+	double variance;
+	double growth;
+	double n0;
+	double ror;
+} RuinResult;
+
+/* Function prototypes. */
+int ruin_kelly(const RuinBin *bins, size_t num_bins, const RuinConfig *config,
+	       double *bets);
+int ruin_analytic(const RuinBin *bins, size_t num_bins, const double *bets,
+		  const RuinConfig *config, RuinResult *result);
+int ruin_simulate(const RuinBin *bins, size_t num_bins, const double *bets,
+		  const RuinConfig *config, RuinResult *result);
+
+#endif // RUIN_H
@@ -0,0 +1,279 @@
+/*
+ * session.c - Bankroll trajectories of blackjack sessions with a bet ramp.
+ */
+#include <errno.h>
+#include <stdlib.h>
+#include "cards.h"
+#include "pool.h"
+#include "session.h"
+#include "sim.h"
+
+/*
+ * struct session_job - A bankroll simulation run on a thread pool.
+ * @config: Configuration of the run.
+ * @total: Merged results of finished threads.
+ */
+struct session_job {
+	const SessionConfig *config;
+	SessionResult *total;
+};
+
+/*
+ * struct session_local - State of one thread of a bankroll simulation.
+ * @shoe: Shoe every session of the thread is dealt from.
+ * @result: Sessions the thread has played.
+ */
+struct session_local {
+	Deck *shoe;
+	SessionResult result;
+};
+
+/*
+ * struct session_play - A session in progress, tracked in half units.
+ * @config: Configuration of the run.
+ * @result: Result the session is added to.
+ * @bankroll: Current bankroll.
+ * @goal: Bankroll at which the session stops.
+ * @peak: Highest bankroll so far.
+ * @drawdown: Largest fall from @peak so far.
+ * @bet: Units bet on the round being dealt.
+ */
+struct session_play {
+	const SessionConfig *config;
+	SessionResult *result;
+	int64_t bankroll;
+	int64_t goal;
+	int64_t peak;
+	int64_t drawdown;
+	int64_t bet;
+};
+
+/*
+ * session_bet - Place the ramp's bet before a round of a session.
+ * @arg: Pointer to the struct session_play.
+ * @bin: True count bin of the round.
+ *
+ * Return: 0 to deal the round, 1 if the bankroll cannot cover the bet.
+ */
+static int session_bet(void *arg, int bin)
+{
+	struct session_play *play = arg;
+	play->bet = play->config->ramp[bin];
+	if (2 * play->bet > play->bankroll) {
+		play->result->ruined++;
+		return 1;
+	}
+	return 0;
+}
+
+/*
+ * session_settle - Settle the bet on a round of a session.
+ * @arg: Pointer to the struct session_play.
+ * @bin: True count bin the round started in.
+ * @record: Round that was played.
+ *
+ * Return: 0 to deal on, 1 if the session reached its win goal.
+ */
+static int session_settle(void *arg, int bin, const BlackjackRecord *record)
+{
+	(void)bin;
+	struct session_play *play = arg;
+	if (play->bet == 0)
+		return 0;
+	play->bankroll += blackjack_net(record->player_score,
+					record->dealer_score) * play->bet;
+	play->result->bets++;
+	play->result->wagered += (uint64_t)play->bet;
+	if (play->bankroll > play->peak)
+		play->peak = play->bankroll;
+	else if (play->peak - play->bankroll > play->drawdown)
+		play->drawdown = play->peak - play->bankroll;
+	if (play->config->win_goal > 0 && play->bankroll >= play->goal) {
+		play->result->goals++;
+		return 1;
+	}
+	return 0;
+}
+
+/*
+ * play_session - Play one session and stream it into a result.
+ * @config: Configuration of the run.
+ * @session: Index of the session, selects the stream its shoe is seeded with.
+ * @shoe: Shoe generated with @config->packs packs, renewed before use.
+ * @result: Result to add the session to.
+ *
+ * Bankrolls are tracked in half units so every payout is exact.
+ *
+ * Return: 0 on success, -1 on error with errno set.
+ */
+static int play_session(const SessionConfig *config, size_t session,
+			Deck *shoe, SessionResult *result)
+{
+	struct session_play play = {
+		.config = config,
+		.result = result,
+		.bankroll = 2 * config->bankroll,
+		.goal = 2 * (config->bankroll + config->win_goal),
+		.peak = 2 * config->bankroll,
+	};
+	SimTable table = {
+		.seed = config->seed,
+		.stream = session,
+		.penetration = config->penetration,
+		.hit_soft_17 = config->hit_soft_17,
+		.max_rounds = config->max_rounds,
+		.arg = &play,
+		.before = session_bet,
+		.after = session_settle,
+	};
+	size_t rounds;
+	if (sim_deal(&table, shoe, &rounds) < 0)
+		return -1;
+	if (sketch_add(&result->bankroll, play.bankroll / 2.0) < 0 ||
+	    sketch_add(&result->drawdown, play.drawdown / 2.0) < 0 ||
+	    sketch_add(&result->length, (double)rounds) < 0)
+		return -1;
+	result->sessions++;
+	result->rounds += rounds;
+	result->net += play.bankroll - 2 * config->bankroll;
+	return 0;
+}
+
+/*
+ * session_start - Set up a thread of a bankroll simulation.
+ * @arg: Pointer to the struct session_job.
+ *
+ * Return: Pointer to the thread's struct session_local, or NULL on error
+ * with errno set.
+ */
+static void *session_start(void *arg)
+{
+	const struct session_job *job = arg;
+	struct session_local *local = malloc(sizeof(*local));
+	if (local == NULL) {
+		errno = ENOMEM;
+		return NULL;
+	}
+	// Every session reseeds the shoe, so any seed will do but not rand()'s
+	local->shoe = deck_gen_seeded(job->config->packs, job->config->seed, 0);
+	if (local->shoe == NULL) {
+		free(local);
+		return NULL;
+	}
+	session_init(&local->result);
+	return local;
+}
+
+/*
+ * session_item - Play one session on a thread.
+ * @arg: Pointer to the struct session_job.
+ * @local: Pointer to the thread's struct session_local.
+ * @session: Index of the session.
+ *
+ * Return: 0 on success, -1 on error with errno set.
+ */
+static int session_item(void *arg, void *local, size_t session)
+{
+	const struct session_job *job = arg;
+	struct session_local *thread = local;
+	return play_session(job->config, session, thread->shoe,
+			    &thread->result);
+}
+
+/*
+ * session_gather - Merge a thread's sessions into the run's result.
+ * @arg: Pointer to the struct session_job.
+ * @local: Pointer to the thread's struct session_local.
+ */
+static void session_gather(void *arg, void *local)
+{
+	const struct session_job *job = arg;
+	const struct session_local *thread = local;
+	session_merge(job->total, &thread->result);
+}
+
+/*
+ * session_finish - Free a thread of a bankroll simulation.
+ * @arg: Pointer to the struct session_job.
+ * @local: Pointer to the thread's struct session_local.
+ */
+static void session_finish(void *arg, void *local)
+{
+	(void)arg;
+	struct session_local *thread = local;
+	unload_deck(thread->shoe);
+	free(thread);
+}
+
+/*
+ * session_init - Empty a session result.
+ * @result: Result to empty.
+ */
+void session_init(SessionResult *result)
+{
+	result->sessions = 0;
+	result->ruined = 0;
+	result->goals = 0;
+	result->rounds = 0;
+	result->bets = 0;
+	result->wagered = 0;
+	result->net = 0;
+	sketch_init(&result->bankroll);
+	sketch_init(&result->drawdown);
+	sketch_init(&result->length);
+}
+
+/*
+ * session_merge - Add one session result to another.
+ * @into: Result to add to.
+ * @from: Result to add.
+ */
+void session_merge(SessionResult *into, const SessionResult *from)
+{
+	into->sessions += from->sessions;
+	into->ruined += from->ruined;
+	into->goals += from->goals;
+	into->rounds += from->rounds;
+	into->bets += from->bets;
+	into->wagered += from->wagered;
+	into->net += from->net;
+	sketch_merge(&into->bankroll, &from->bankroll);
+	sketch_merge(&into->drawdown, &from->drawdown);
+	sketch_merge(&into->length, &from->length);
+}
+
+/*
+ * session_run - Simulate bankroll trajectories over many sessions.
+ * @config: Configuration of the run.
+ * @result: Where to store the result, emptied first.
+ *
+ * Sessions are dealt by sim_deal(), betting @config->ramp at the true count
+ * kept by deck_count(). Each session deals from its own seeded shoe and every tally merges exactly, so the result depends only on the
+ * configuration and never on thread count or scheduling. Final bankrolls,
+ * drawdowns and lengths stream into quantile sketches, so memory stays
+ * constant per thread however many sessions are run.
+ *
+ * Return: 0 on success, -1 on error with errno set.
+ */
+int session_run(const SessionConfig *config, SessionResult *result)
+{
+	if (config == NULL || result == NULL || config->packs < 1 ||
+	    !(config->penetration > 0.0 && config->penetration <= 1.0) ||
+	    config->max_rounds == 0 || config->bankroll <= 0 ||
+	    config->win_goal < 0) {
+		errno = EINVAL;
+		return -1;
+	}
+	session_init(result);
+	struct session_job job = { .config = config, .total = result };
+	PoolTask task = {
+		.items = config->sessions,
+		.threads = config->threads,
+		.arg = &job,
+		.start = session_start,
+		.item = session_item,
+		.merge = session_gather,
+		.finish = session_finish,
+	};
+	return pool_run(&task);
+}
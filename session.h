@@ -0,0 +1,75 @@
+#ifndef SESSION_H
+#define SESSION_H
+
+#include <stddef.h> // provides size_t
+#include <stdint.h> // provides uint64_t
+#include "cards.h"
+#include "sketch.h"
+
+/*
+ * struct session_config - Parameters of a bankroll simulation.
+ * @packs: Number of packs in each shoe.
+ * @penetration: Fraction of the shoe dealt before it is reshuffled.
+ * @hit_soft_17: If the dealer hits soft 17.
+ * @seed: Seed of the run, session n deals from stream n of this seed.
+ * @sessions: Number of sessions to simulate.
+ * @max_rounds: Rounds dealt before a session ends.
+ * @threads: Number of threads, 0 or 1 to run on the calling thread.
+ * @bankroll: Bankroll each session starts with, in betting units.
+ * @win_goal: Winnings in units at which a session stops, 0 to play on.
+ * @ramp: Bet in units at each Hi-Lo true count bin of count_bin(), bin i
+ *        holding true count COUNT_MIN_TC + i. A bet of 0 watches the round
+ *        unwagered.
+ *
+ * A session ends after @max_rounds rounds, on reaching @win_goal, or when
+ * the bankroll cannot cover the next bet, which counts as ruin.
+ */
+typedef struct session_config {
+	int packs;
+	double penetration;
+	_Bool hit_soft_17;
+	uint64_t seed;
+	size_t sessions;
+	size_t max_rounds;
+	int threads;
+	int64_t bankroll;
+	int64_t win_goal;
+	uint32_t ramp[COUNT_BINS];
+} SessionConfig;
+
+/*
+ * struct session_result - Distribution of simulated sessions.
+ * @sessions: Number of sessions played.
+ * @ruined: Sessions that ended unable to cover a bet.
+ * @goals: Sessions that ended on reaching the win goal.
+ * @rounds: Rounds dealt over every session.
+ * @bets: Rounds wagered on.
+ * @wagered: Units wagered.
+ * @net: Net winnings in half units (a blackjack pays 3 per unit bet).
+ * @bankroll: Final bankroll of each session, in units.
+ * @drawdown: Largest fall from a running peak in each session, in units.
+ * @length: Rounds dealt in each session.
+ *
+ * Sessions stream into the sketches as they finish, so a result takes the
+ * same memory for any number of sessions, and merging results is exact and
+ * order free.
+ */
+typedef struct session_result {
+	uint64_t sessions;
+	uint64_t ruined;
+	uint64_t goals;
+	uint64_t rounds;
+	uint64_t bets;
+	uint64_t wagered;
+	int64_t net;
+	QuantileSketch bankroll;
+	QuantileSketch drawdown;
+	QuantileSketch length;
+} SessionResult;
+
+/* Function prototypes. */
+void session_init(SessionResult *result);
+void session_merge(SessionResult *into, const SessionResult *from);
+int session_run(const SessionConfig *config, SessionResult *result);
+
+#endif // SESSION_H
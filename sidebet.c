@@ -0,0 +1,253 @@
+/*
+ * sidebet.c - Exact prices of blackjack side bets from the shoe composition.
+ */
+#include <errno.h>
+#include "sidebet.h"
+
+#define RANKS 13
+#define SUITS 4
+#define SIDE_MIN_CARDS 4 // Lucky Ladies looks at four cards
+#define STRAIGHTS 12 // A-2-3 through Q-K-A
+
+/*
+ * card_index - Index of a card in a composition.
+ * @rank: Rank index, 0 for aces through 12 for kings.
+ * @suit: Suit of the card.
+ *
+ * Return: Index as deck_composition() lays counts out.
+ */
+static int card_index(int rank, int suit)
+{
+	return suit * RANKS + rank;
+}
+
+/*
+ * same_color - Check if two suits share a colour.
+ * @a: First suit.
+ * @b: Second suit.
+ *
+ * Return: 1 if both are black or both are red, otherwise 0.
+ */
+static _Bool same_color(int a, int b)
+{
+	return (a == DIAMONDS || a == HEARTS) == (b == DIAMONDS || b == HEARTS);
+}
+
+/*
+ * ladies_value - Blackjack value of a rank for Lucky Ladies.
+ * @rank: Rank index, 0 for aces through 12 for kings.
+ *
+ * Return: 11 for aces, 10 for ten-valued cards, otherwise the pip value.
+ */
+static int ladies_value(int rank)
+{
+	if (rank == 0)
+		return 11;
+	return rank >= 9 ? 10 : rank + 1;
+}
+
+/*
+ * price_21_3 - Price 21+3.
+ * @n: Cards left of each card, as deck_composition() lays them out.
+ * @ranks: Cards left of each rank.
+ * @suits: Cards left of each suit.
+ * @total: Total cards left.
+ * @win: Where to store the probability of any payout.
+ *
+ * Every category is a closed form over falling factorials of the counts,
+ * counting ordered draws, with the better categories taken out of the
+ * worse ones they overlap.
+ *
+ * Return: Expected return per unit.
+ */
+static double price_21_3(const unsigned *n, const double *ranks,
+			 const double *suits, double total, double *win)
+{
+	double suited_trips = 0.0, trips = 0.0, flushes = 0.0;
+	for (int c = 0; c < RANKS * SUITS; c++)
+		suited_trips += (double)n[c] * (n[c] - 1.0) * (n[c] - 2.0);
+	for (int r = 0; r < RANKS; r++)
+		trips += ranks[r] * (ranks[r] - 1.0) * (ranks[r] - 2.0);
+	for (int s = 0; s < SUITS; s++)
+		flushes += suits[s] * (suits[s] - 1.0) * (suits[s] - 2.0);
+	double straights = 0.0, straight_flushes = 0.0;
+	for (int low = 0; low < STRAIGHTS; low++) {
+		int a = low, b = low + 1, c = (low + 2) % RANKS; // Q-K-A wraps
+		straights += 6.0 * ranks[a] * ranks[b] * ranks[c];
+		for (int s = 0; s < SUITS; s++)
+			straight_flushes += 6.0 * n[card_index(a, s)] *
+					    n[card_index(b, s)] *
+					    n[card_index(c, s)];
+	}
+	double draws = total * (total - 1.0) * (total - 2.0);
+	double p_suited_trips = suited_trips / draws;
+	double p_trips = (trips - suited_trips) / draws;
+	double p_straight_flush = straight_flushes / draws;
+	double p_straight = (straights - straight_flushes) / draws;
+	double p_flush = (flushes - straight_flushes - suited_trips) / draws;
+	*win = p_suited_trips + p_straight_flush + p_trips + p_straight +
+	       p_flush;
+	return 100.0 * p_suited_trips + 40.0 * p_straight_flush +
+	       30.0 * p_trips + 10.0 * p_straight + 5.0 * p_flush -
+	       (1.0 - *win);
+}
+
+/*
+ * price_perfect_pairs - Price Perfect Pairs.
+ * @n: Cards left of each card.
+ * @total: Total cards left.
+ * @win: Where to store the probability of any payout.
+ *
+ * Return: Expected return per unit.
+ */
+static double price_perfect_pairs(const unsigned *n, double total,
+				  double *win)
+{
+	double perfect = 0.0, colored = 0.0, mixed = 0.0;
+	for (int r = 0; r < RANKS; r++) {
+		for (int s = 0; s < SUITS; s++) {
+			double a = n[card_index(r, s)];
+			perfect += a * (a - 1.0);
+			for (int t = 0; t < SUITS; t++) {
+				if (t == s)
+					continue;
+				double pair = a * n[card_index(r, t)];
+				if (same_color(s, t))
+					colored += pair;
+				else
+					mixed += pair;
+			}
+		}
+	}
+	double draws = total * (total - 1.0);
+	*win = (perfect + colored + mixed) / draws;
+	return (25.0 * perfect + 12.0 * colored + 6.0 * mixed) / draws -
+	       (1.0 - *win);
+}
+
+/*
+ * price_lucky_ladies - Price Lucky Ladies.
+ * @n: Cards left of each card.
+ * @ranks: Cards left of each rank.
+ * @total: Total cards left.
+ * @win: Where to store the probability of any payout.
+ *
+ * A dealer blackjack behind the queens of hearts is priced on the shoe left
+ * after both queens are drawn.
+ *
+ * Return: Expected return per unit.
+ */
+static double price_lucky_ladies(const unsigned *n, const double *ranks,
+				 double total, double *win)
+{
+	double queens = 0.0, matched = 0.0, suited = 0.0, other = 0.0;
+	int heart_queen = card_index(QUEEN - ACE, HEARTS);
+	for (int a = 0; a < RANKS * SUITS; a++) {
+		for (int b = 0; b < RANKS * SUITS; b++) {
+			if (ladies_value(a % RANKS) + ladies_value(b % RANKS) != 20)
+				continue;
+			double pairs = (double)n[a] * (n[b] - (a == b ? 1.0 : 0.0));
+			if (a == heart_queen && b == heart_queen)
+				queens += pairs;
+			else if (a == b)
+				matched += pairs;
+			else if (a / RANKS == b / RANKS)
+				suited += pairs;
+			else
+				other += pairs;
+		}
+	}
+	double draws = total * (total - 1.0);
+	double tens = ranks[9] + ranks[10] + ranks[11] + ranks[12] - 2.0;
+	double dealer_blackjack = 2.0 * ranks[0] * tens /
+				  ((total - 2.0) * (total - 3.0));
+	double p_queens = queens / draws;
+	*win = (queens + matched + suited + other) / draws;
+	return p_queens * (1000.0 * dealer_blackjack +
+			   125.0 * (1.0 - dealer_blackjack)) +
+	       (19.0 * matched + 9.0 * suited + 4.0 * other) / draws -
+	       (1.0 - *win);
+}
+
+/*
+ * sidebet_ev - Price every side bet on the next round.
+ * @counts: Cards left, as deck_composition() lays them out.
+ * @ev: Where to store the prices.
+ *
+ * The bets only depend on the first three or four cards, so each payout's
+ * probability is a sum of products of the per-card, per-rank and per-suit
+ * counts rather than an enumeration of hands. The sums are short loops
+ * over flat arrays of doubles that the compiler vectorises, and a
+ * shoe prices in a few microseconds, so every round of a simulation can be
+ * priced.
+ *
+ * Return: 0 on success, -1 on error with errno set to EINVAL, or ENODATA if
+ * fewer than four cards are left.
+ */
+int sidebet_ev(const unsigned *counts, SideBetEv *ev)
+{
+	if (counts == NULL || ev == NULL) {
+		errno = EINVAL;
+		return -1;
+	}
+	double ranks[RANKS] = { 0 }, suits[SUITS] = { 0 }, total = 0.0;
+	for (int s = 0; s < SUITS; s++) {
+		for (int r = 0; r < RANKS; r++) {
+			ranks[r] += counts[card_index(r, s)];
+			suits[s] += counts[card_index(r, s)];
+		}
+		total += suits[s];
+	}
+	if (total < SIDE_MIN_CARDS) {
+		errno = ENODATA;
+		return -1;
+	}
+	ev->ev[SIDE_21_3] = price_21_3(counts, ranks, suits, total,
+				       &ev->win[SIDE_21_3]);
+	ev->ev[SIDE_PERFECT_PAIRS] = price_perfect_pairs(counts, total,
+				&ev->win[SIDE_PERFECT_PAIRS]);
+	ev->ev[SIDE_LUCKY_LADIES] = price_lucky_ladies(counts, ranks, total,
+				&ev->win[SIDE_LUCKY_LADIES]);
+	return 0;
+}
+
+/*
+ * sidebet_scan - Price the side bets before every round of a shoe.
+ * @deck: Shuffled shoe to play through.
+ * @cut: Cards left at which the shoe ends.
+ * @hit_soft_17: If the dealer hits soft 17.
+ * @scan: Tallies to add the shoe to.
+ *
+ * Rounds are played with blackjack_auto(). Before each one the composition
+ * left is priced and every bet with a positive expectation is tallied, so
+ * many shoes can be scanned into one result to measure how exploitable each
+ * bet is to a perfect counter.
+ *
+ * Return: 0 on success, -1 on error with errno set.
+ */
+int sidebet_scan(Deck *deck, size_t cut, _Bool hit_soft_17,
+		 SideBetScan *scan)
+{
+	if (deck == NULL || scan == NULL || cut < SIDE_MIN_CARDS) {
+		errno = EINVAL;
+		return -1;
+	}
+	unsigned counts[STANDARD_DECK_SIZE];
+	while (deck_size(deck) > cut) {
+		SideBetEv ev;
+		if (deck_composition(deck, counts) < 0 ||
+		    sidebet_ev(counts, &ev) < 0)
+			return -1;
+		for (int bet = 0; bet < SIDE_BETS; bet++) {
+			if (ev.ev[bet] > 0) {
+				scan->positive[bet]++;
+				scan->gain[bet] += ev.ev[bet];
+			}
+		}
+		BlackjackRecord record = { .hit_soft_17 = hit_soft_17 };
+		if (blackjack_auto(deck, &record) < 0)
+			return -1;
+		scan->rounds++;
+	}
+	return 0;
+}
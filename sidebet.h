@@ -0,0 +1,58 @@
+#ifndef SIDEBET_H
+#define SIDEBET_H
+
+#include <stddef.h> // provides size_t
+#include <stdint.h> // provides uint64_t
+#include "cards.h"
+
+/* The blackjack side bets priced by sidebet_ev(). */
+typedef enum side_bet {
+	/*
+	 * 21+3, the player's two cards and the dealer's upcard as a poker hand:
+	 * suited trips 100, straight flush 40, trips 30, straight 10 and
+	 * flush 5 to 1.
+	 */
+	SIDE_21_3,
+	/*
+	 * Perfect Pairs, the player's two cards: perfect pair 25, coloured pair
+	 * 12 and mixed pair 6 to 1.
+	 */
+	SIDE_PERFECT_PAIRS,
+	/*
+	 * Lucky Ladies, the player's two cards totalling 20: queens of hearts
+	 * with a dealer blackjack 1000, queens of hearts 125, matched 19,
+	 * suited 9 and any other 20 4 to 1.
+	 */
+	SIDE_LUCKY_LADIES,
+	SIDE_BETS
+} SideBet;
+
+/*
+ * struct side_bet_ev - Exact prices of the side bets on the next round.
+ * @win: Probability each bet pays anything.
+ * @ev: Expected return per unit staked on each bet.
+ */
+typedef struct side_bet_ev {
+	double win[SIDE_BETS];
+	double ev[SIDE_BETS];
+} SideBetEv;
+
+/*
+ * struct side_bet_scan - Side bets with an edge over the rounds of shoes.
+ * @rounds: Rounds played.
+ * @positive: Rounds where each bet had a positive expectation.
+ * @gain: Summed expectation of each bet over the rounds where it was
+ *        positive, the return of a player betting only then.
+ */
+typedef struct side_bet_scan {
+	uint64_t rounds;
+	uint64_t positive[SIDE_BETS];
+	double gain[SIDE_BETS];
+} SideBetScan;
+
+/* Function prototypes. */
+int sidebet_ev(const unsigned *counts, SideBetEv *ev);
+int sidebet_scan(Deck *deck, size_t cut, _Bool hit_soft_17,
+		 SideBetScan *scan);
+
+#endif // SIDEBET_H
@@ -0,0 +1,1389 @@
+/*
+ * sim.c - Headless simulation of blackjack played with basic strategy.
+ */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE // provides pthread_setaffinity_np() and CPU_SET()
+#endif
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include "sim.h"
+
+#define CACHE_LINE 64
+#define NODE_DIR "/sys/devices/system/node"
+#define CPU_ONLINE "/sys/devices/system/cpu/online"
+
+#define CHECKPOINT_MAGIC "CCSIM"
+#define CHECKPOINT_VERSION 4
+#define REGION_MAGIC "CCSHM"
+#define REGION_VERSION 6
+
+#define SLOT_OPEN 0 // Unit not published yet
+#define SLOT_DONE 1 // Unit's result published
+#define LEASE_DONE ULLONG_MAX // Lease of a published unit, never runs out
+
+// Shared memory atomics must not fall back to process-local locks
+_Static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "64-bit atomics must be lock-free");
+
+/*
+ * struct sim_checkpoint - Header of a simulation checkpoint file.
+ * @magic: CHECKPOINT_MAGIC, NUL padded.
+ * @version: CHECKPOINT_VERSION of the writer.
+ * @packs: Packs per shoe of the run.
+ * @seed: Seed of the run.
+ * @units: Number of work units in the run.
+ * @rounds_per_unit: Rounds in each work unit.
+ * @penetration: Penetration of the run.
+ * @hit_soft_17: If the dealer hits soft 17 in the run.
+ * @csm_shelves: Shelves of the run's continuous shuffler, 0 for shoes.
+ * @completed: Number of work units completed.
+ * @result: Aggregate of the completed work units.
+ *
+ * The header is followed by a bitmap with one bit per work unit, set once
+ * the unit has been merged into @result. Units reseed their shoe from the
+ * run seed and their own stream, so the bitmap is all the generator state a
+ * resumed run needs.
+ */
+struct sim_checkpoint {
+	char magic[8];
+	uint32_t version;
+	int32_t packs;
+	uint64_t seed;
+	uint64_t units;
+	uint64_t rounds_per_unit;
+	double penetration;
+	uint64_t hit_soft_17;
+	uint64_t csm_shelves;
+	uint64_t completed;
+	SimResult result;
+};
+
+/*
+ * struct sim_slot - Result of one work unit in a shared region.
+ * @lease: CLOCK_MONOTONIC time in nanoseconds the worker's claim on the unit
+ *         runs out, 0 if the unit has not been claimed, or LEASE_DONE once
+ *         it is published.
+ * @state: SLOT_OPEN, then SLOT_DONE, set with release ordering, once
+ *         @result is written.
+ * @failed: Number of times a worker failed to simulate the unit, cleared
+ *          when the unit is published.
+ * @result: Outcome of the work unit.
+ *
+ * The lease covers writing @result as well as simulating the unit, so a
+ * worker that dies at any point before publishing leaves a lease that runs
+ * out, and another worker can claim the unit again. If the first worker was
+ * only slow both simulate the unit, but only the one still holding the
+ * lease publishes it.
+ */
+struct sim_slot {
+	atomic_ullong lease;
+	atomic_uint state;
+	atomic_uint failed;
+	SimResult result;
+};
+
+/*
+ * struct sim_region - Layout of a shared memory simulation region.
+ * @magic: REGION_MAGIC, NUL padded.
+ * @version: REGION_VERSION of the creator.
+ * @packs: Packs per shoe of the run.
+ * @seed: Seed of the run.
+ * @units: Number of work units in the run.
+ * @rounds_per_unit: Rounds in each work unit.
+ * @penetration: Penetration of the run.
+ * @hit_soft_17: If the dealer hits soft 17 in the run.
+ * @csm_shelves: Shelves of the run's continuous shuffler, 0 for shoes.
+ * @lease: Nanoseconds a worker's claim on a unit lasts.
+ * @ready: Set with release ordering once the region is initialised.
+ * @next_unit: Next work unit to hand out. Workers take units with a single
+ *             fetch-and-add, so the queue of units is lock-free.
+ * @completed: Number of work units published.
+ * @slots: One result slot per work unit, each published by one worker only.
+ */
+struct sim_region {
+	char magic[8];
+	uint32_t version;
+	int32_t packs;
+	uint64_t seed;
+	uint64_t units;
+	uint64_t rounds_per_unit;
+	double penetration;
+	uint32_t hit_soft_17;
+	uint32_t csm_shelves;
+	uint64_t lease;
+	atomic_uint ready;
+	atomic_ullong next_unit;
+	atomic_ullong completed;
+	struct sim_slot slots[];
+};
+
+/*
+ * struct sim_shared - A process's handle on a shared simulation region.
+ * @region: Mapping of the region.
+ * @size: Size of the mapping in bytes.
+ * @config: Configuration of the run, without a checkpoint.
+ */
+struct sim_shared {
+	struct sim_region *region;
+	size_t size;
+	SimConfig config;
+};
+
+/*
+ * struct sim_state - State shared by the workers of a simulation run.
+ * @config: Configuration of the run.
+ * @lock: Protects every other member but @saved.
+ * @total: Aggregate of the completed work units.
+ * @done: Bitmap of completed work units.
+ * @completed: Number of completed work units.
+ * @unsaved: Units completed since the last checkpoint was taken.
+ * @error: errno of the first failure, or 0.
+ * @save_lock: Serialises checkpoint writes and protects @saved.
+ * @saved: Completed units recorded by the last checkpoint written.
+ *
+ * Checkpoints are copied under @lock but written under @save_lock only, so
+ * workers keep merging results while one of them waits on the disk.
+ */
+struct sim_state {
+	const SimConfig *config;
+	pthread_mutex_t lock;
+	SimResult total;
+	unsigned char *done;
+	size_t completed;
+	size_t unsaved;
+	int error;
+	pthread_mutex_t save_lock;
+	size_t saved;
+};
+
+/*
+ * struct sim_deque - Work-stealing deque of work units.
+ * @units: Units owned by the deque, filled before any worker starts.
+ * @top: Index of the next unit for thieves to steal.
+ * @bottom: Index one past the next unit for the owner to pop.
+ *
+ * A Chase-Lev deque without growth: the owner pops from @bottom and thieves
+ * take from @top, so they only contend over the last unit. The two ends sit
+ * on their own cache lines so steals do not slow the owner's pops.
+ */
+struct sim_deque {
+	size_t *units;
+	_Alignas(CACHE_LINE) atomic_llong top;
+	_Alignas(CACHE_LINE) atomic_llong bottom;
+};
+
+/*
+ * struct sim_worker - State of a simulation worker thread.
+ * @state: State shared by the run.
+ * @workers: Every worker of the run, for stealing.
+ * @count: Number of workers.
+ * @index: Index of this worker.
+ * @cpu: CPU the worker is pinned to, or -1 if it is not pinned.
+ * @shoe: Shoe the worker deals every unit from, allocated by the worker.
+ * @result: Buffer the worker's unit results land in, allocated by the worker.
+ * @rng: Generator used to pick victims to steal from.
+ * @deque: Units queued for this worker.
+ *
+ * Workers are allocated as a cache-line-aligned array and each worker is
+ * padded to whole cache lines, so no two workers share a line. @shoe and
+ * @result are allocated by the worker thread after it is pinned, so first
+ * touch places them on the worker's own NUMA node.
+ */
+struct sim_worker {
+	_Alignas(CACHE_LINE) struct sim_state *state;
+	struct sim_worker *workers;
+	size_t count;
+	size_t index;
+	int cpu;
+	Deck *shoe;
+	SimResult *result;
+	Rng rng;
+	struct sim_deque deque;
+};
+
+/*
+ * tally - Add the outcome of a round to a result.
+ * @result: Result to add to.
+ * @record: Round that was played.
+ * @bin: True count bin the round started in.
+ */
+static void tally(SimResult *result, const BlackjackRecord *record, int bin)
+{
+	int64_t net = blackjack_net(record->player_score,
+				    record->dealer_score);
+	if (net > 0) {
+		result->wins++;
+		if (net == 3)
+			result->blackjacks++;
+	} else if (net < 0) {
+		result->losses++;
+	} else {
+		result->pushes++;
+	}
+	result->rounds++;
+	result->net += net;
+	result->net_sq += (uint64_t)(net * net);
+	result->tc_rounds[bin]++;
+	result->tc_net[bin] += net;
+	result->tc_net_sq[bin] += (uint64_t)(net * net);
+}
+
+/*
+ * tally_round - Tally a round dealt by sim_deal() into a result.
+ * @arg: Pointer to the SimResult to add to.
+ * @bin: True count bin the round started in.
+ * @record: Round that was played.
+ *
+ * Return: 0 to deal on.
+ */
+static int tally_round(void *arg, int bin, const BlackjackRecord *record)
+{
+	tally(arg, record, bin);
+	return 0;
+}
+
+/*
+ * reshuffle - Gather every card of a shoe and shuffle it.
+ * @shoe: Shoe to reshuffle.
+ *
+ * Return: 0 on success, -1 on error with errno set.
+ */
+static int reshuffle(Deck *shoe)
+{
+	if (deck_restack(shoe) < 0)
+		return -1;
+	return deck_shuffle(shoe);
+}
+
+/*
+ * valid_config - Check a simulation configuration.
+ * @config: Configuration to check.
+ *
+ * Return: 1 if the configuration can be run, otherwise 0.
+ */
+static _Bool valid_config(const SimConfig *config)
+{
+	return config != NULL && config->packs > 0 &&
+	       (config->csm_shelves > 0 || (config->penetration > 0.0 &&
+					    config->penetration <= 1.0));
+}
+
+/*
+ * sim_deal - Deal rounds of blackjack from a freshly shuffled shoe.
+ * @table: Rounds to deal and what to do with each.
+ * @shoe: Shoe to deal from, renewed and seeded with @table->seed and
+ *        @table->stream before use.
+ * @played: Where to store the number of rounds played, or NULL.
+ *
+ * Deals up to @table->max_rounds rounds with blackjack_auto(), reshuffling
+ * once the penetration is reached. A round that runs out of cards is voided
+ * and dealt again from a fresh shuffle, and is never passed to
+ * @table->after. With @table->csm_shelves set the shoe is loaded into a
+ * continuous shuffler instead and every round's cards go back into it as
+ * soon as it ends. Each round is binned by the true count deck_count() keeps
+ * as the shoe is dealt.
+ *
+ * Return: 0 on success, -1 on error with errno set.
+ */
+int sim_deal(const SimTable *table, Deck *shoe, size_t *played)
+{
+	if (table == NULL || table->after == NULL || shoe == NULL) {
+		errno = EINVAL;
+		return -1;
+	}
+	if (deck_renew(shoe) < 0 ||
+	    deck_seed(shoe, table->seed, table->stream) < 0 ||
+	    deck_shuffle(shoe) < 0)
+		return -1;
+	_Bool csm = table->csm_shelves > 0;
+	if (csm && deck_csm(shoe, table->csm_shelves) < 0)
+		return -1;
+	size_t cards = deck_size(shoe);
+	size_t cut = (size_t)(table->penetration * (double)cards);
+	BlackjackRecord record = { .hit_soft_17 = table->hit_soft_17 };
+	size_t round = 0;
+	int ret = 0;
+	while (ret == 0 && round < table->max_rounds) {
+		if (!csm && cards - deck_size(shoe) >= cut &&
+		    reshuffle(shoe) < 0)
+			return -1;
+		double true_count;
+		if (deck_count(shoe, NULL, &true_count) < 0)
+			return -1;
+		int bin = count_bin(true_count);
+		if (table->before != NULL) {
+			ret = table->before(table->arg, bin);
+			if (ret != 0)
+				break;
+		}
+		int dealt = blackjack_auto(shoe, &record);
+		if (dealt < 0 && errno != ENODATA)
+			return -1;
+		if (csm) {
+			if (deck_csm_return(shoe) < 0)
+				return -1;
+		} else if (dealt < 0 && reshuffle(shoe) < 0) {
+			return -1;
+		}
+		if (dealt < 0)
+			continue; // Void the round and deal it again
+		round++;
+		ret = table->after(table->arg, bin, &record);
+	}
+	if (ret < 0)
+		return -1;
+	if (played != NULL)
+		*played = round;
+	return 0;
+}
+
+/*
+ * play_unit - Simulate one work unit on an existing shoe.
+ * @config: Configuration of the run.
+ * @unit: Index of the unit, selects the stream its shoe is seeded with.
+ * @shoe: Shoe generated with @config->packs packs, renewed before use.
+ * @result: Where to store the outcome of the unit.
+ *
+ * Return: 0 on success, -1 on error with errno set.
+ */
+static int play_unit(const SimConfig *config, size_t unit, Deck *shoe,
+		     SimResult *result)
+{
+	SimResult local = { 0 };
+	SimTable table = {
+		.seed = config->seed,
+		.stream = unit,
+		.penetration = config->penetration,
+		.hit_soft_17 = config->hit_soft_17,
+		.csm_shelves = config->csm_shelves,
+		.max_rounds = config->rounds_per_unit,
+		.arg = &local,
+		.after = tally_round,
+	};
+	if (sim_deal(&table, shoe, NULL) < 0)
+		return -1;
+	*result = local;
+	return 0;
+}
+
+/*
+ * sim_unit - Simulate one work unit.
+ * @config: Configuration of the run.
+ * @unit: Index of the unit, selects the stream its shoe is seeded with.
+ * @result: Where to store the outcome of the unit.
+ *
+ * Plays @config->rounds_per_unit rounds with sim_deal(). Each round is
+ * tallied under the true count deck_count() keeps as the shoe is dealt, so
+ * the count bins cost no pass of their own.
+ *
+ * Return: 0 on success, -1 on error with errno set.
+ */
+int sim_unit(const SimConfig *config, size_t unit, SimResult *result)
+{
+	if (!valid_config(config) || result == NULL) {
+		errno = EINVAL;
+		return -1;
+	}
+	Deck *shoe = deck_gen_seeded(config->packs, config->seed, unit);
+	if (shoe == NULL) {
+		return -1;
+	}
+	int ret = play_unit(config, unit, shoe, result);
+	unload_deck(shoe);
+	return ret;
+}
+
+/*
+ * sim_merge - Add one simulation result to another.
+ * @into: Result to add to.
+ * @from: Result to add.
+ */
+void sim_merge(SimResult *into, const SimResult *from)
+{
+	into->rounds += from->rounds;
+	into->wins += from->wins;
+	into->losses += from->losses;
+	into->pushes += from->pushes;
+	into->blackjacks += from->blackjacks;
+	into->net += from->net;
+	into->net_sq += from->net_sq;
+	for (int i = 0; i < COUNT_BINS; i++) {
+		into->tc_rounds[i] += from->tc_rounds[i];
+		into->tc_net[i] += from->tc_net[i];
+		into->tc_net_sq[i] += from->tc_net_sq[i];
+	}
+}
+
+/*
+ * sim_ev - Player's expected value per round.
+ * @result: Result of a simulation.
+ *
+ * Return: Mean winnings per round in bets, negative for a house edge.
+ */
+double sim_ev(const SimResult *result)
+{
+	if (result == NULL || result->rounds == 0)
+		return 0.0;
+	return (double)result->net / 2.0 / (double)result->rounds;
+}
+
+/*
+ * sim_variance - Variance of the player's winnings per round.
+ * @result: Result of a simulation.
+ *
+ * Return: Variance in squared bets.
+ */
+double sim_variance(const SimResult *result)
+{
+	if (result == NULL || result->rounds == 0)
+		return 0.0;
+	double mean = sim_ev(result);
+	double mean_sq = (double)result->net_sq / 4.0 / (double)result->rounds;
+	return mean_sq - mean * mean;
+}
+
+/*
+ * sim_count_bins - Edge and variance of a unit bet at each true count.
+ * @result: Result of a simulation.
+ * @bins: Where to store COUNT_BINS bins, bin i for true count
+ *        COUNT_MIN_TC + i, ready for ruin_kelly() and ruin_analytic().
+ *
+ * Return: 0 on success, -1 on error with errno set.
+ */
+int sim_count_bins(const SimResult *result, RuinBin *bins)
+{
+	if (result == NULL || bins == NULL) {
+		errno = EINVAL;
+		return -1;
+	}
+	for (int i = 0; i < COUNT_BINS; i++) {
+		double rounds = (double)result->tc_rounds[i];
+		bins[i].freq = rounds;
+		bins[i].ev = 0.0;
+		bins[i].variance = 0.0;
+		if (result->tc_rounds[i] == 0)
+			continue;
+		double mean = (double)result->tc_net[i] / 2.0 / rounds;
+		double mean_sq = (double)result->tc_net_sq[i] / 4.0 / rounds;
+		bins[i].ev = mean;
+		bins[i].variance = mean_sq - mean * mean;
+	}
+	return 0;
+}
+
+/*
+ * checkpoint_take - Copy the state of a run into a checkpoint image.
+ * @state: State of the run, locked by the caller.
+ * @size: Where to store the size of the image in bytes.
+ *
+ * Return: Image to pass to checkpoint_write(), or NULL on error with errno
+ * set.
+ */
+static unsigned char *checkpoint_take(struct sim_state *state, size_t *size)
+{
+	const SimConfig *config = state->config;
+	size_t bitmap = (config->units + 7) / 8;
+	*size = sizeof(struct sim_checkpoint) + bitmap;
+	unsigned char *image = calloc(1, *size);
+	if (image == NULL) {
+		errno = ENOMEM;
+		return NULL;
+	}
+	struct sim_checkpoint *header = (struct sim_checkpoint *)image;
+	memcpy(header->magic, CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC));
+	header->version = CHECKPOINT_VERSION;
+	header->packs = config->packs;
+	header->seed = config->seed;
+	header->units = config->units;
+	header->rounds_per_unit = config->rounds_per_unit;
+	header->penetration = config->penetration;
+	header->hit_soft_17 = config->hit_soft_17;
+	header->csm_shelves = config->csm_shelves;
+	header->completed = state->completed;
+	header->result = state->total;
+	memcpy(image + sizeof(*header), state->done, bitmap);
+	state->unsaved = 0;
+	return image;
+}
+
+/*
+ * checkpoint_write - Write a checkpoint image and free it.
+ * @state: State of the run, not locked by the caller.
+ * @image: Image from checkpoint_take().
+ * @size: Size of @image in bytes.
+ *
+ * Images can reach here out of order when several workers take them, so an
+ * image older than the last one written is dropped.
+ *
+ * Return: 0 on success, -1 on error with errno set.
+ */
+static int checkpoint_write(struct sim_state *state, unsigned char *image,
+			    size_t size)
+{
+	const struct sim_checkpoint *header = (const void *)image;
+	int ret = 0;
+	pthread_mutex_lock(&state->save_lock);
+	if (header->completed > state->saved || state->saved == 0) {
+		ret = file_write_atomic(state->config->checkpoint, image, size);
+		if (ret == 0)
+			state->saved = header->completed;
+	}
+	pthread_mutex_unlock(&state->save_lock);
+	free(image);
+	return ret;
+}
+
+/*
+ * checkpoint_load - Resume a run from its checkpoint, if there is one.
+ * @state: State of the run to fill.
+ *
+ * Return: 0 on success or if there is no checkpoint yet, -1 on error with
+ * errno set to EINVAL if the checkpoint belongs to a different run or
+ * EBADMSG if it is corrupt.
+ */
+static int checkpoint_load(struct sim_state *state)
+{
+	const SimConfig *config = state->config;
+	FILE *file = fopen(config->checkpoint, "rb");
+	if (file == NULL) {
+		return errno == ENOENT ? 0 : -1;
+	}
+	struct sim_checkpoint header;
+	size_t bitmap = (config->units + 7) / 8;
+	int ret = -1;
+	if (fread(&header, sizeof(header), 1, file) != 1 ||
+	    memcmp(header.magic, CHECKPOINT_MAGIC,
+		   sizeof(CHECKPOINT_MAGIC)) != 0 ||
+	    header.version != CHECKPOINT_VERSION) {
+		errno = EBADMSG;
+		goto out;
+	}
+	if (header.packs != config->packs || header.seed != config->seed ||
+	    header.units != config->units ||
+	    header.rounds_per_unit != config->rounds_per_unit ||
+	    header.penetration != config->penetration ||
+	    header.hit_soft_17 != config->hit_soft_17 ||
+	    header.csm_shelves != config->csm_shelves) {
+		errno = EINVAL;
+		goto out;
+	}
+	if (fread(state->done, 1, bitmap, file) != bitmap) {
+		errno = EBADMSG;
+		goto out;
+	}
+	state->total = header.result;
+	state->completed = header.completed;
+	ret = 0;
+out:
+	fclose(file);
+	return ret;
+}
+
+/*
+ * deque_pop - Pop a unit from the owner's end of a deque.
+ * @deque: Deque owned by the calling worker.
+ * @unit: Where to store the unit.
+ *
+ * Return: 1 if a unit was popped, 0 if the deque is empty.
+ */
+static _Bool deque_pop(struct sim_deque *deque, size_t *unit)
+{
+	long long bottom = atomic_load_explicit(&deque->bottom,
+						memory_order_relaxed) - 1;
+	atomic_store_explicit(&deque->bottom, bottom, memory_order_relaxed);
+	atomic_thread_fence(memory_order_seq_cst);
+	long long top = atomic_load_explicit(&deque->top, memory_order_relaxed);
+	if (top > bottom) {
+		atomic_store_explicit(&deque->bottom, bottom + 1,
+				      memory_order_relaxed);
+		return 0;
+	}
+	*unit = deque->units[bottom];
+	if (top < bottom)
+		return 1;
+	// Last unit, race any thief for it
+	_Bool won = atomic_compare_exchange_strong_explicit(
+		&deque->top, &top, top + 1, memory_order_seq_cst,
+		memory_order_relaxed);
+	atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+	return won;
+}
+
+/*
+ * deque_steal - Steal a unit from the thieves' end of a deque.
+ * @deque: Deque owned by another worker.
+ * @unit: Where to store the unit.
+ *
+ * Return: 1 if a unit was stolen, 0 if the deque is empty, or -1 if another
+ * worker took the unit first and the steal should be retried.
+ */
+static int deque_steal(struct sim_deque *deque, size_t *unit)
+{
+	long long top = atomic_load_explicit(&deque->top, memory_order_acquire);
+	atomic_thread_fence(memory_order_seq_cst);
+	long long bottom = atomic_load_explicit(&deque->bottom,
+						memory_order_acquire);
+	if (top >= bottom)
+		return 0;
+	size_t stolen = deque->units[top];
+	if (!atomic_compare_exchange_strong_explicit(
+		    &deque->top, &top, top + 1, memory_order_seq_cst,
+		    memory_order_relaxed))
+		return -1;
+	*unit = stolen;
+	return 1;
+}
+
+/*
+ * next_unit - Find the next unit for a worker to simulate.
+ * @worker: Worker looking for work.
+ * @unit: Where to store the unit.
+ *
+ * Pops from the worker's own deque, then steals from the others starting at
+ * a random victim. No units are queued once workers start, so a sweep that
+ * finds every deque empty means the run is out of work.
+ *
+ * Return: 1 if a unit was found, 0 if there is no work left.
+ */
+static _Bool next_unit(struct sim_worker *worker, size_t *unit)
+{
+	if (deque_pop(&worker->deque, unit))
+		return 1;
+	_Bool contended;
+	do {
+		contended = 0;
+		size_t first = rng_bounded(&worker->rng, (uint32_t)worker->count);
+		for (size_t i = 0; i < worker->count; i++) {
+			struct sim_worker *victim =
+				&worker->workers[(first + i) % worker->count];
+			if (victim == worker)
+				continue;
+			int ret = deque_steal(&victim->deque, unit);
+			if (ret > 0)
+				return 1;
+			if (ret < 0)
+				contended = 1;
+		}
+	} while (contended);
+	return 0;
+}
+
+/*
+ * parse_cpulist - Parse a sysfs CPU list such as "0-3,8-11".
+ * @text: List to parse.
+ * @cpus: Array to append the CPUs to.
+ * @count: Number of CPUs already in @cpus.
+ * @max: Capacity of @cpus.
+ *
+ * CPUs that do not fit a cpu_set_t are left out, so every CPU returned can
+ * be passed to CPU_SET().
+ *
+ * Return: Number of CPUs in @cpus after parsing.
+ */
+static size_t parse_cpulist(const char *text, int *cpus, size_t count,
+			    size_t max)
+{
+	const char *ptr = text;
+	while (*ptr != '\0' && *ptr != '\n') {
+		char *end;
+		long first = strtol(ptr, &end, 10);
+		if (end == ptr)
+			break;
+		long last = first;
+		if (*end == '-') {
+			ptr = end + 1;
+			last = strtol(ptr, &end, 10);
+			if (end == ptr)
+				break;
+		}
+		if (first < 0)
+			first = 0;
+		if (last >= CPU_SETSIZE)
+			last = CPU_SETSIZE - 1;
+		for (long cpu = first; cpu <= last && count < max; cpu++)
+			cpus[count++] = (int)cpu;
+		ptr = *end == ',' ? end + 1 : end;
+	}
+	return count;
+}
+
+/*
+ * read_cpulist - Read and parse a sysfs CPU list file.
+ * @path: Path of the file.
+ * @cpus: Array to append the CPUs to.
+ * @count: Number of CPUs already in @cpus.
+ * @max: Capacity of @cpus.
+ *
+ * Return: Number of CPUs in @cpus after parsing, @count if the file could
+ * not be read.
+ */
+static size_t read_cpulist(const char *path, int *cpus, size_t count,
+			   size_t max)
+{
+	char text[4096];
+	FILE *file = fopen(path, "r");
+	if (file == NULL)
+		return count;
+	if (fgets(text, sizeof(text), file) != NULL)
+		count = parse_cpulist(text, cpus, count, max);
+	fclose(file);
+	return count;
+}
+
+/*
+ * place_workers - Choose a CPU for each worker, spreading them over nodes.
+ * @workers: Workers to place.
+ * @count: Number of workers.
+ *
+ * Reads the CPUs of each NUMA node from sysfs and deals workers out to the
+ * nodes in turn, so every node's memory bandwidth is used. Machines without
+ * NUMA nodes in sysfs are treated as one node of all online CPUs. Workers
+ * are left unpinned if no CPUs can be found.
+ */
+static void place_workers(struct sim_worker *workers, size_t count)
+{
+	enum { MAX_NODES = 64, MAX_CPUS = 1024 };
+	int cpus[MAX_CPUS];
+	size_t node_first[MAX_NODES + 1];
+	size_t nodes = 0;
+	size_t total = 0;
+	for (size_t i = 0; i < count; i++)
+		workers[i].cpu = -1;
+
+	DIR *dir = opendir(NODE_DIR);
+	if (dir != NULL) {
+		int ids[MAX_NODES];
+		struct dirent *entry;
+		while ((entry = readdir(dir)) != NULL && nodes < MAX_NODES) {
+			int id;
+			char tail;
+			if (sscanf(entry->d_name, "node%d%c", &id, &tail) == 1)
+				ids[nodes++] = id;
+		}
+		closedir(dir);
+		// readdir() order is arbitrary, keep nodes in id order
+		for (size_t i = 1; i < nodes; i++) {
+			for (size_t j = i; j > 0 && ids[j - 1] > ids[j]; j--) {
+				int tmp = ids[j];
+				ids[j] = ids[j - 1];
+				ids[j - 1] = tmp;
+			}
+		}
+		size_t found = 0;
+		for (size_t i = 0; i < nodes; i++) {
+			char path[64];
+			snprintf(path, sizeof(path), NODE_DIR "/node%d/cpulist",
+				 ids[i]);
+			size_t before = total;
+			total = read_cpulist(path, cpus, total, MAX_CPUS);
+			if (total > before) // Skip memory-only nodes
+				node_first[found++] = before;
+		}
+		nodes = found;
+	}
+	if (nodes == 0) {
+		total = read_cpulist(CPU_ONLINE, cpus, 0, MAX_CPUS);
+		nodes = total > 0;
+		node_first[0] = 0;
+	}
+	if (nodes == 0)
+		return;
+	node_first[nodes] = total;
+	for (size_t i = 0; i < count; i++) {
+		size_t node = i % nodes;
+		size_t size = node_first[node + 1] - node_first[node];
+		workers[i].cpu = cpus[node_first[node] + (i / nodes) % size];
+	}
+}
+
+/*
+ * sim_work - Simulate work units until none are left.
+ * @arg: Pointer to the worker's struct sim_worker.
+ *
+ * Return: NULL, failures are recorded in the shared state.
+ */
+static void *sim_work(void *arg)
+{
+	struct sim_worker *worker = arg;
+	struct sim_state *state = worker->state;
+	const SimConfig *config = state->config;
+	if (worker->cpu >= 0 && worker->cpu < CPU_SETSIZE) {
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		CPU_SET(worker->cpu, &set);
+		// Placement only affects speed, so run unpinned if it fails
+		pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+	}
+	// Every unit reseeds the shoe, so any seed will do but not rand()'s
+	worker->shoe = deck_gen_seeded(config->packs, config->seed, 0);
+	worker->result = aligned_alloc(CACHE_LINE, (sizeof(SimResult) +
+					   CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE);
+	if (worker->shoe == NULL || worker->result == NULL) {
+		if (worker->shoe != NULL)
+			unload_deck(worker->shoe);
+		free(worker->result);
+		pthread_mutex_lock(&state->lock);
+		if (state->error == 0)
+			state->error = ENOMEM;
+		pthread_mutex_unlock(&state->lock);
+		return NULL;
+	}
+	size_t unit;
+	while (next_unit(worker, &unit)) {
+		SimResult *result = worker->result;
+		int ret = play_unit(config, unit, worker->shoe, result);
+		int err = errno;
+		unsigned char *image = NULL;
+		size_t size;
+		pthread_mutex_lock(&state->lock);
+		if (ret < 0) {
+			if (state->error == 0)
+				state->error = err;
+		} else {
+			sim_merge(&state->total, result);
+			state->done[unit / 8] |= (unsigned char)(1u << (unit % 8));
+			state->completed++;
+			state->unsaved++;
+			if (config->checkpoint != NULL &&
+			    config->checkpoint_every > 0 &&
+			    state->unsaved >= config->checkpoint_every &&
+			    (image = checkpoint_take(state, &size)) == NULL &&
+			    state->error == 0)
+				state->error = errno;
+		}
+		_Bool stop = state->error != 0;
+		pthread_mutex_unlock(&state->lock);
+		if (image != NULL && checkpoint_write(state, image, size) < 0) {
+			err = errno;
+			pthread_mutex_lock(&state->lock);
+			if (state->error == 0)
+				state->error = err;
+			pthread_mutex_unlock(&state->lock);
+			stop = 1;
+		}
+		if (stop)
+			break;
+	}
+	unload_deck(worker->shoe);
+	free(worker->result);
+	worker->shoe = NULL;
+	worker->result = NULL;
+	return NULL;
+}
+
+/*
+ * sim_run - Run a blackjack simulation.
+ * @config: Configuration of the run.
+ * @result: Where to store the aggregate of all work units.
+ *
+ * If @config->checkpoint names an existing checkpoint of the same run, the
+ * units it records as done are skipped and its aggregate is carried over, so
+ * a resumed run produces exactly the result of an uninterrupted one. The
+ * checkpoint is rewritten atomically every @config->checkpoint_every units
+ * and once more when the run completes.
+ *
+ * Return: 0 on success, -1 on error with errno set.
+ */
+int sim_run(const SimConfig *config, SimResult *result)
+{
+	if (!valid_config(config) || result == NULL) {
+		errno = EINVAL;
+		return -1;
+	}
+	struct sim_state state = { .config = config };
+	state.done = calloc((config->units + 7) / 8 + 1, 1);
+	if (state.done == NULL) {
+		errno = ENOMEM;
+		return -1;
+	}
+	if (config->checkpoint != NULL && checkpoint_load(&state) < 0) {
+		free(state.done);
+		return -1;
+	}
+	pthread_mutex_init(&state.lock, NULL);
+	pthread_mutex_init(&state.save_lock, NULL);
+
+	size_t count = config->threads > 1 ? (size_t)config->threads : 1;
+	struct sim_worker *workers = aligned_alloc(CACHE_LINE,
+						   count * sizeof(*workers));
+	pthread_t *threads = calloc(count, sizeof(*threads));
+	size_t *units = calloc(config->units + 1, sizeof(*units));
+	if (workers == NULL || threads == NULL || units == NULL) {
+		free(workers);
+		free(threads);
+		free(units);
+		free(state.done);
+		pthread_mutex_destroy(&state.lock);
+		pthread_mutex_destroy(&state.save_lock);
+		errno = ENOMEM;
+		return -1;
+	}
+	// Queue each worker a contiguous block of the units still to do
+	size_t pending = 0;
+	for (size_t unit = 0; unit < config->units; unit++) {
+		if (!(state.done[unit / 8] & (1u << (unit % 8))))
+			units[pending++] = unit;
+	}
+	memset(workers, 0, count * sizeof(*workers));
+	for (size_t i = 0; i < count; i++) {
+		size_t first = pending * i / count;
+		size_t last = pending * (i + 1) / count;
+		workers[i].state = &state;
+		workers[i].workers = workers;
+		workers[i].count = count;
+		workers[i].index = i;
+		workers[i].deque.units = units + first;
+		atomic_init(&workers[i].deque.top, 0);
+		atomic_init(&workers[i].deque.bottom, (long long)(last - first));
+		rng_seed(&workers[i].rng, config->seed, i);
+	}
+	if (config->numa)
+		place_workers(workers, count);
+	else
+		for (size_t i = 0; i < count; i++)
+			workers[i].cpu = -1;
+	size_t started = 0;
+	if (count == 1 && !config->numa) {
+		sim_work(&workers[0]);
+	} else {
+		for (; started < count; started++) {
+			int err = pthread_create(&threads[started], NULL, sim_work,
+						 &workers[started]);
+			if (err != 0) {
+				pthread_mutex_lock(&state.lock);
+				state.error = err;
+				pthread_mutex_unlock(&state.lock);
+				break;
+			}
+		}
+		for (size_t i = 0; i < started; i++)
+			pthread_join(threads[i], NULL);
+	}
+	if (state.error == 0 && config->checkpoint != NULL) {
+		size_t size;
+		unsigned char *image = checkpoint_take(&state, &size);
+		if (image == NULL || checkpoint_write(&state, image, size) < 0)
+			state.error = errno;
+	}
+
+	int error = state.error;
+	if (error == 0)
+		*result = state.total;
+	free(workers);
+	free(threads);
+	free(units);
+	free(state.done);
+	pthread_mutex_destroy(&state.lock);
+	pthread_mutex_destroy(&state.save_lock);
+	if (error != 0) {
+		errno = error;
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * sim_bench - Measure how simulation throughput scales with threads.
+ * @out: Stream to print the table to.
+ * @config: Configuration to run, its checkpoint and threads are ignored.
+ * @max_threads: Largest number of threads to measure.
+ *
+ * Runs @config with 1, 2, 4 and so on up to @max_threads threads and prints
+ * the rounds per second overall and per thread for each. With no false
+ * sharing the per-thread figure should stay flat up to the core count.
+ *
+ * Return: 0 on success, -1 on error with errno set.
+ */
+int sim_bench(FILE *out, const SimConfig *config, int max_threads)
+{
+	if (out == NULL || config == NULL || max_threads < 1) {
+		errno = EINVAL;
+		return -1;
+	}
+	SimConfig run = *config;
+	run.checkpoint = NULL;
+	fprintf(out, "%8s %10s %14s %14s\n", "threads", "seconds", "rounds/s",
+		"rounds/s/thr");
+	for (int threads = 1;; threads *= 2) {
+		if (threads > max_threads)
+			threads = max_threads;
+		run.threads = threads;
+		SimResult result;
+		struct timespec start, end;
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		if (sim_run(&run, &result) < 0)
+			return -1;
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		double seconds = (double)(end.tv_sec - start.tv_sec) +
+				 (double)(end.tv_nsec - start.tv_nsec) / 1e9;
+		double rate = (double)result.rounds / seconds;
+		fprintf(out, "%8d %10.3f %14.0f %14.0f\n", threads, seconds, rate,
+			rate / threads);
+		if (threads == max_threads)
+			break;
+	}
+	return 0;
+}
+
+/*
+ * region_size - Size of a shared region for a number of work units.
+ * @units: Number of work units.
+ *
+ * Return: Size of the region in bytes.
+ */
+static size_t region_size(size_t units)
+{
+	return sizeof(struct sim_region) + units * sizeof(struct sim_slot);
+}
+
+/*
+ * sim_shared_create - Create a shared memory region for a simulation run.
+ * @name: POSIX shared memory name, such as "/blackjack-run".
+ * @config: Configuration of the run, its checkpoint and threads are ignored.
+ *
+ * Worker processes attach with sim_shared_attach() and call
+ * sim_shared_work(), while the creator watches sim_shared_result().
+ *
+ * Return: Handle on the region, or NULL on error with errno set.
+ */
+SimShared *sim_shared_create(const char *name, const SimConfig *config)
+{
+	if (name == NULL || !valid_config(config)) {
+		errno = EINVAL;
+		return NULL;
+	}
+	SimShared *shared = malloc(sizeof(*shared));
+	if (shared == NULL) {
+		errno = ENOMEM;
+		return NULL;
+	}
+	int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+	if (fd < 0) {
+		free(shared);
+		return NULL;
+	}
+	shared->size = region_size(config->units);
+	if (ftruncate(fd, (off_t)shared->size) < 0) {
+		int saved = errno;
+		close(fd);
+		shm_unlink(name);
+		free(shared);
+		errno = saved;
+		return NULL;
+	}
+	shared->region = mmap(NULL, shared->size, PROT_READ | PROT_WRITE,
+			      MAP_SHARED, fd, 0);
+	close(fd);
+	if (shared->region == MAP_FAILED) {
+		int saved = errno;
+		shm_unlink(name);
+		free(shared);
+		errno = saved;
+		return NULL;
+	}
+	struct sim_region *region = shared->region;
+	memcpy(region->magic, REGION_MAGIC, sizeof(REGION_MAGIC));
+	region->version = REGION_VERSION;
+	region->packs = config->packs;
+	region->seed = config->seed;
+	region->units = config->units;
+	region->rounds_per_unit = config->rounds_per_unit;
+	region->penetration = config->penetration;
+	region->hit_soft_17 = config->hit_soft_17;
+	region->csm_shelves = config->csm_shelves;
+	region->lease = (uint64_t)(config->lease > 0 ? config->lease :
+				   SIM_LEASE) * 1000000000u;
+	atomic_init(&region->next_unit, 0);
+	atomic_init(&region->completed, 0);
+	for (size_t i = 0; i < config->units; i++) {
+		atomic_init(&region->slots[i].lease, 0);
+		atomic_init(&region->slots[i].state, SLOT_OPEN);
+		atomic_init(&region->slots[i].failed, 0);
+	}
+	atomic_store_explicit(&region->ready, 1, memory_order_release);
+	shared->config = *config;
+	shared->config.checkpoint = NULL;
+	shared->config.threads = 1;
+	return shared;
+}
+
+/*
+ * sim_shared_attach - Attach to a shared simulation region.
+ * @name: Name the region was created with.
+ *
+ * Return: Handle on the region, or NULL on error with errno set to EAGAIN if
+ * the region is not initialised yet or EBADMSG if it is not a region.
+ */
+SimShared *sim_shared_attach(const char *name)
+{
+	if (name == NULL) {
+		errno = EINVAL;
+		return NULL;
+	}
+	int fd = shm_open(name, O_RDWR, 0);
+	if (fd < 0) {
+		return NULL;
+	}
+	struct stat st;
+	if (fstat(fd, &st) < 0) {
+		close(fd);
+		return NULL;
+	}
+	size_t size = (size_t)st.st_size;
+	if (size < sizeof(struct sim_region)) {
+		close(fd);
+		errno = EAGAIN;
+		return NULL;
+	}
+	struct sim_region *region = mmap(NULL, size, PROT_READ | PROT_WRITE,
+					 MAP_SHARED, fd, 0);
+	close(fd);
+	if (region == MAP_FAILED) {
+		return NULL;
+	}
+	int error = 0;
+	if (!atomic_load_explicit(&region->ready, memory_order_acquire))
+		error = EAGAIN;
+	else if (memcmp(region->magic, REGION_MAGIC, sizeof(REGION_MAGIC)) != 0 ||
+		 region->version != REGION_VERSION ||
+		 size < region_size(region->units))
+		error = EBADMSG;
+	SimShared *shared = error ? NULL : malloc(sizeof(*shared));
+	if (shared == NULL) {
+		munmap(region, size);
+		errno = error ? error : ENOMEM;
+		return NULL;
+	}
+	shared->region = region;
+	shared->size = size;
+	shared->config = (SimConfig){
+		.packs = region->packs,
+		.penetration = region->penetration,
+		.hit_soft_17 = region->hit_soft_17,
+		.csm_shelves = region->csm_shelves,
+		.seed = region->seed,
+		.units = region->units,
+		.rounds_per_unit = region->rounds_per_unit,
+		.threads = 1,
+		.lease = (unsigned)(region->lease / 1000000000u),
+	};
+	return shared;
+}
+
+/*
+ * monotonic_ns - Read the monotonic clock.
+ *
+ * Return: CLOCK_MONOTONIC time in nanoseconds, the same in every process.
+ */
+static uint64_t monotonic_ns(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+}
+
+/*
+ * claim_unit - Claim a unit of a shared region.
+ * @region: Region holding the unit.
+ * @unit: Index of the unit.
+ *
+ * Return: Lease now held by the caller if the unit was unclaimed, or its
+ * lease ran out, otherwise 0.
+ */
+static uint64_t claim_unit(struct sim_region *region, uint64_t unit)
+{
+	struct sim_slot *slot = &region->slots[unit];
+	if (atomic_load_explicit(&slot->state, memory_order_relaxed) !=
+	    SLOT_OPEN)
+		return 0;
+	uint64_t now = monotonic_ns();
+	unsigned long long lease = atomic_load_explicit(&slot->lease,
+							memory_order_relaxed);
+	if (lease != 0 && lease > now)
+		return 0;
+	if (!atomic_compare_exchange_strong_explicit(
+		    &slot->lease, &lease, now + region->lease,
+		    memory_order_relaxed, memory_order_relaxed))
+		return 0;
+	return now + region->lease;
+}
+
+/*
+ * publish_unit - Simulate a claimed unit and publish its result.
+ * @shared: Handle on the region.
+ * @unit: Index of the unit.
+ * @lease: Lease on the unit returned by claim_unit().
+ *
+ * The lease is renewed before the result is written and given up for
+ * LEASE_DONE once it is, so a worker that stops while writing loses the
+ * unit like one that stops while simulating it.
+ *
+ * Return: 1 if the caller published the unit, 0 if another worker took
+ * over its lease, or -1 on error with errno set.
+ */
+static int publish_unit(SimShared *shared, uint64_t unit, uint64_t lease)
+{
+	struct sim_region *region = shared->region;
+	struct sim_slot *slot = &region->slots[unit];
+	SimResult result;
+	if (sim_unit(&shared->config, unit, &result) < 0) {
+		atomic_fetch_add_explicit(&slot->failed, 1,
+					  memory_order_relaxed);
+		return -1;
+	}
+	unsigned long long held = lease;
+	uint64_t renewed = monotonic_ns() + region->lease;
+	if (!atomic_compare_exchange_strong_explicit(
+		    &slot->lease, &held, renewed, memory_order_relaxed,
+		    memory_order_relaxed))
+		return 0;
+	slot->result = result; // Every worker writes a unit's same result
+	held = renewed;
+	if (!atomic_compare_exchange_strong_explicit(
+		    &slot->lease, &held, LEASE_DONE, memory_order_relaxed,
+		    memory_order_relaxed))
+		return 0;
+	atomic_store_explicit(&slot->failed, 0, memory_order_relaxed);
+	atomic_store_explicit(&slot->state, SLOT_DONE, memory_order_release);
+	atomic_fetch_add_explicit(&region->completed, 1, memory_order_release);
+	return 1;
+}
+
+/*
+ * sim_shared_work - Simulate work units from a shared region until none are
+ * left.
+ * @shared: Handle on the region.
+ *
+ * Units are handed out with one atomic fetch-and-add and leased to the
+ * worker that claims them, simulated with sim_unit() and published to their
+ * own slot, so no locks are taken and several processes can work the same
+ * region at once. Once every unit is handed out, the call sweeps the slots
+ * for units whose lease ran out without being published, such as those of a
+ * worker that died, and simulates them too. A controller waiting on
+ * sim_shared_result() can call it again to pick up such units.
+ *
+ * Return: Number of units this call published, or -1 on error with errno
+ * set.
+ */
+long sim_shared_work(SimShared *shared)
+{
+	if (shared == NULL) {
+		errno = EINVAL;
+		return -1;
+	}
+	struct sim_region *region = shared->region;
+	long worked = 0;
+	for (;;) {
+		uint64_t unit = atomic_fetch_add_explicit(&region->next_unit, 1,
+							  memory_order_relaxed);
+		if (unit >= region->units)
+			break;
+		uint64_t lease = claim_unit(region, unit);
+		if (lease == 0)
+			continue; // Reclaimed by a sweep before it was handed out
+		int ret = publish_unit(shared, unit, lease);
+		if (ret < 0)
+			return -1;
+		worked += ret;
+	}
+	for (uint64_t unit = 0; unit < region->units; unit++) {
+		uint64_t lease = claim_unit(region, unit);
+		if (lease == 0)
+			continue;
+		int ret = publish_unit(shared, unit, lease);
+		if (ret < 0)
+			return -1;
+		worked += ret;
+	}
+	return worked;
+}
+
+/*
+ * sim_shared_result - Combine the results published to a shared region.
+ * @shared: Handle on the region.
+ * @result: Where to store the combined result of the published units.
+ * @completed: Where to store the number of published units, may be NULL.
+ *
+ * May be called while workers are running, only fully published units are
+ * included. Units held by a worker that died stay unpublished until another
+ * sim_shared_work() call takes them over once their lease runs out.
+ *
+ * Return: 1 once every unit is published, 0 if some are still running, or -1
+ * on error with errno set to EIO if a worker failed a unit that no other
+ * worker has published since.
+ */
+int sim_shared_result(const SimShared *shared, SimResult *result,
+		      size_t *completed)
+{
+	if (shared == NULL || result == NULL) {
+		errno = EINVAL;
+		return -1;
+	}
+	struct sim_region *region = shared->region;
+	SimResult total = { 0 };
+	size_t published = 0;
+	_Bool failed = 0;
+	for (size_t i = 0; i < region->units; i++) {
+		struct sim_slot *slot = &region->slots[i];
+		if (atomic_load_explicit(&slot->state, memory_order_acquire) ==
+		    SLOT_DONE) {
+			sim_merge(&total, &slot->result);
+			published++;
+		} else if (atomic_load_explicit(&slot->failed,
+						memory_order_relaxed) > 0) {
+			failed = 1;
+		}
+	}
+	*result = total;
+	if (completed != NULL)
+		*completed = published;
+	if (failed) {
+		errno = EIO;
+		return -1;
+	}
+	return published == region->units;
+}
+
+/*
+ * sim_shared_detach - Unmap a shared region and free its handle.
+ * @shared: Handle on the region.
+ *
+ * Return: 0 on success, -1 on error with errno set.
+ */
+int sim_shared_detach(SimShared *shared)
+{
+	if (shared == NULL) {
+		errno = EINVAL;
+		return -1;
+	}
+	int ret = munmap(shared->region, shared->size);
+	free(shared);
+	return ret;
+}
+
+/*
+ * sim_shared_unlink - Remove a shared region's name.
+ * @name: Name the region was created with.
+ *
+ * Processes still attached keep their mapping until they detach.
+ *
+ * Return: 0 on success, -1 on error with errno set.
+ */
+int sim_shared_unlink(const char *name)
+{
+	if (name == NULL) {
+		errno = EINVAL;
+		return -1;
+	}
+	return shm_unlink(name);
+}
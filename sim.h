@@ -0,0 +1,128 @@
+#ifndef SIM_H
+#define SIM_H
+
+#include <stddef.h> // provides size_t
+#include <stdio.h> // provides FILE
+#include <stdint.h> // provides uint64_t
+#include "cards.h"
+#include "ruin.h"
+
+#define SIM_LEASE 60 // Default seconds a shared region unit stays claimed
+
+/*
+ * struct sim_config - Parameters of a headless blackjack simulation.
+ * @packs: Number of packs in each shoe.
+ * @penetration: Fraction of the shoe dealt before it is reshuffled.
+ * @hit_soft_17: If the dealer hits soft 17.
+ * @csm_shelves: Shelves of a continuous shuffling machine to deal from, see
+ *               deck_csm(), or 0 to deal shoes to @penetration.
+ * @seed: Seed of the run, work unit n deals from stream n of this seed.
+ * @units: Number of work units to simulate.
+ * @rounds_per_unit: Rounds of blackjack played in each work unit.
+ * @threads: Number of worker threads, 0 or 1 to run on the calling thread.
+ *           Threads balance uneven units by stealing work from each other.
+ * @numa: Pin each worker thread to a core, spreading them over NUMA nodes,
+ *        and allocate the worker's shoe and buffers on its own node.
+ * @checkpoint: Path of the checkpoint file, or NULL to run without one.
+ * @checkpoint_every: Completed units between checkpoints, 0 for only the end.
+ * @lease: Seconds a worker of a shared region may hold a unit before other
+ *         workers take it over, 0 for SIM_LEASE. Must outlast a unit.
+ *
+ * Every unit plays from its own seeded shoe, so results depend only on the
+ * configuration and never on thread count or scheduling.
+ */
+typedef struct sim_config {
+	int packs;
+	double penetration;
+	_Bool hit_soft_17;
+	unsigned csm_shelves;
+	uint64_t seed;
+	size_t units;
+	size_t rounds_per_unit;
+	int threads;
+	_Bool numa;
+	const char *checkpoint;
+	size_t checkpoint_every;
+	unsigned lease;
+} SimConfig;
+
+/*
+ * struct sim_result - Aggregated outcome of simulated rounds.
+ * @rounds: Number of rounds played.
+ * @wins: Rounds won by the player, including blackjacks.
+ * @losses: Rounds lost by the player.
+ * @pushes: Rounds drawn.
+ * @blackjacks: Rounds won with a blackjack.
+ * @net: Player's net winnings in half bets (a blackjack pays 3).
+ * @net_sq: Sum of the squared per-round winnings in half bets.
+ * @tc_rounds: Rounds started at each true count.
+ * @tc_net: Net winnings in half bets of the rounds at each true count.
+ * @tc_net_sq: Sum of the squared winnings of the rounds at each true count.
+ *
+ * Bin i holds the rounds whose Hi-Lo true count, binned by count_bin(), was
+ * COUNT_MIN_TC + i before the first card was dealt. Everything is an
+ * integer, so merging results is exact and order free.
+ */
+typedef struct sim_result {
+	uint64_t rounds;
+	uint64_t wins;
+	uint64_t losses;
+	uint64_t pushes;
+	uint64_t blackjacks;
+	int64_t net;
+	uint64_t net_sq;
+	uint64_t tc_rounds[COUNT_BINS];
+	int64_t tc_net[COUNT_BINS];
+	uint64_t tc_net_sq[COUNT_BINS];
+} SimResult;
+
+/*
+ * struct sim_table - Rounds dealt from one seeded shoe by sim_deal().
+ * @seed: Seed the shoe is shuffled with.
+ * @stream: Stream of @seed the shoe is shuffled with.
+ * @penetration: Fraction of the shoe dealt before it is reshuffled.
+ * @hit_soft_17: If the dealer hits soft 17.
+ * @csm_shelves: Shelves of a continuous shuffling machine to deal from, see
+ *               deck_csm(), or 0 to deal the shoe to @penetration.
+ * @max_rounds: Rounds dealt before the table closes.
+ * @arg: Passed to @before and @after.
+ * @before: Called with the true count bin before each round is dealt, or
+ *          NULL. Return 0 to deal the round, 1 to close the table without
+ *          dealing it, or -1 with errno set.
+ * @after: Called with the true count bin the round started in and its
+ *         record once it is played. Return 0 to deal on, 1 to close the
+ *         table, or -1 with errno set.
+ */
+typedef struct sim_table {
+	uint64_t seed;
+	uint64_t stream;
+	double penetration;
+	_Bool hit_soft_17;
+	unsigned csm_shelves;
+	size_t max_rounds;
+	void *arg;
+	int (*before)(void *arg, int bin);
+	int (*after)(void *arg, int bin, const BlackjackRecord *record);
+} SimTable;
+
+/* A simulation region shared between processes */
+typedef struct sim_shared SimShared;
+
+/* Function prototypes. */
+int sim_deal(const SimTable *table, Deck *shoe, size_t *played);
+int sim_unit(const SimConfig *config, size_t unit, SimResult *result);
+void sim_merge(SimResult *into, const SimResult *from);
+double sim_ev(const SimResult *result);
+double sim_variance(const SimResult *result);
+int sim_count_bins(const SimResult *result, RuinBin *bins);
+int sim_run(const SimConfig *config, SimResult *result);
+int sim_bench(FILE *out, const SimConfig *config, int max_threads);
+SimShared *sim_shared_create(const char *name, const SimConfig *config);
+SimShared *sim_shared_attach(const char *name);
+long sim_shared_work(SimShared *shared);
+int sim_shared_result(const SimShared *shared, SimResult *result,
+		      size_t *completed);
+int sim_shared_detach(SimShared *shared);
+int sim_shared_unlink(const char *name);
+
+#endif // SIM_H
@@ -0,0 +1,143 @@
+/*
+ * sketch.c - Mergeable quantile sketches with relative error guarantees.
+ */
+#include <errno.h>
+#include <math.h>
+#include <string.h>
+#include "sketch.h"
+
+#define SKETCH_GAMMA ((1.0 + SKETCH_ACCURACY) / (1.0 - SKETCH_ACCURACY))
+
+/*
+ * bucket_of - Bucket of a magnitude.
+ * @magnitude: Magnitude of a value, at least SKETCH_MIN_VALUE.
+ *
+ * Return: Index of the bucket holding @magnitude.
+ */
+static int bucket_of(double magnitude)
+{
+	double index = ceil(log(magnitude / SKETCH_MIN_VALUE) / log(SKETCH_GAMMA));
+	if (index < 0.0)
+		return 0;
+	return index >= SKETCH_BUCKETS ? SKETCH_BUCKETS - 1 : (int)index;
+}
+
+/*
+ * bucket_value - Value that represents a bucket.
+ * @bucket: Index of the bucket.
+ *
+ * Return: Magnitude within SKETCH_ACCURACY of every magnitude in @bucket.
+ */
+static double bucket_value(int bucket)
+{
+	return SKETCH_MIN_VALUE * 2.0 * pow(SKETCH_GAMMA, bucket) /
+	       (SKETCH_GAMMA + 1.0);
+}
+
+/*
+ * sketch_init - Empty a quantile sketch.
+ * @sketch: Sketch to empty.
+ */
+void sketch_init(QuantileSketch *sketch)
+{
+	memset(sketch, 0, sizeof(*sketch));
+	sketch->min = INFINITY;
+	sketch->max = -INFINITY;
+}
+
+/*
+ * sketch_add - Add a value to a quantile sketch.
+ * @sketch: Sketch to add to.
+ * @value: Value to add.
+ *
+ * Return: 0 on success, -1 with errno set to EINVAL if @value is NaN.
+ */
+int sketch_add(QuantileSketch *sketch, double value)
+{
+	if (sketch == NULL || isnan(value)) {
+		errno = EINVAL;
+		return -1;
+	}
+	double magnitude = fabs(value);
+	if (magnitude < SKETCH_MIN_VALUE)
+		sketch->zeros++;
+	else if (value > 0.0)
+		sketch->positive[bucket_of(magnitude)]++;
+	else
+		sketch->negative[bucket_of(magnitude)]++;
+	sketch->count++;
+	if (value < sketch->min)
+		sketch->min = value;
+	if (value > sketch->max)
+		sketch->max = value;
+	return 0;
+}
+
+/*
+ * sketch_merge - Add one quantile sketch to another.
+ * @into: Sketch to add to.
+ * @from: Sketch to add.
+ *
+ * The result is exactly the sketch of every value added to either.
+ */
+void sketch_merge(QuantileSketch *into, const QuantileSketch *from)
+{
+	into->count += from->count;
+	into->zeros += from->zeros;
+	if (from->min < into->min)
+		into->min = from->min;
+	if (from->max > into->max)
+		into->max = from->max;
+	for (int i = 0; i < SKETCH_BUCKETS; i++) {
+		into->positive[i] += from->positive[i];
+		into->negative[i] += from->negative[i];
+	}
+}
+
+/*
+ * clamp - Keep an estimate within the values a sketch has seen.
+ * @sketch: Sketch the estimate came from.
+ * @value: Estimate.
+ *
+ * Return: @value limited to the sketch's minimum and maximum.
+ */
+static double clamp(const QuantileSketch *sketch, double value)
+{
+	if (value < sketch->min)
+		return sketch->min;
+	return value > sketch->max ? sketch->max : value;
+}
+
+/*
+ * sketch_quantile - Estimate a quantile of the values in a sketch.
+ * @sketch: Sketch to query.
+ * @q: Quantile, 0 for the minimum to 1 for the maximum.
+ *
+ * Return: Estimate within SKETCH_ACCURACY of the value of rank
+ * q * (count - 1), or NaN if the sketch is empty or @q is out of range.
+ */
+double sketch_quantile(const QuantileSketch *sketch, double q)
+{
+	if (sketch == NULL || sketch->count == 0 || !(q >= 0.0 && q <= 1.0))
+		return NAN;
+	if (q == 0.0)
+		return sketch->min;
+	if (q == 1.0)
+		return sketch->max;
+	uint64_t rank = (uint64_t)(q * (double)(sketch->count - 1));
+	uint64_t seen = 0;
+	for (int i = SKETCH_BUCKETS - 1; i >= 0; i--) {
+		seen += sketch->negative[i];
+		if (seen > rank)
+			return clamp(sketch, -bucket_value(i));
+	}
+	seen += sketch->zeros;
+	if (seen > rank)
+		return clamp(sketch, 0.0);
+	for (int i = 0; i < SKETCH_BUCKETS; i++) {
+		seen += sketch->positive[i];
+		if (seen > rank)
+			return clamp(sketch, bucket_value(i));
+	}
+	return sketch->max;
+}
@@ -0,0 +1,41 @@
+#ifndef SKETCH_H
+#define SKETCH_H
+
+#include <stdint.h> // provides uint64_t
+
+#define SKETCH_ACCURACY 0.01 // Relative error of every quantile
+#define SKETCH_BUCKETS 2048 // Buckets for each sign, covering 1e-3 to 1e14
+#define SKETCH_MIN_VALUE 1e-3 // Smallest magnitude told apart from zero
+
+/*
+ * struct quantile_sketch - Mergeable sketch of a distribution's quantiles.
+ * @count: Number of values added.
+ * @zeros: Values with a magnitude below SKETCH_MIN_VALUE.
+ * @min: Smallest value added.
+ * @max: Largest value added.
+ * @positive: Positive values by logarithmic bucket.
+ * @negative: Negative values by the logarithmic bucket of their magnitude.
+ *
+ * Bucket i holds magnitudes in (g^(i-1), g^i] times SKETCH_MIN_VALUE, where g
+ * is (1 + SKETCH_ACCURACY) / (1 - SKETCH_ACCURACY), so any quantile is
+ * within SKETCH_ACCURACY of a value actually added. Magnitudes beyond the
+ * last bucket join it. Everything but @min and @max is an integer count, so
+ * merging sketches is exact and order free, and a sketch takes the same
+ * memory however many values it has seen.
+ */
+typedef struct quantile_sketch {
+	uint64_t count;
+	uint64_t zeros;
+	double min;
+	double max;
+	uint64_t positive[SKETCH_BUCKETS];
+	uint64_t negative[SKETCH_BUCKETS];
+} QuantileSketch;
+
+/* Function prototypes. */
+void sketch_init(QuantileSketch *sketch);
+int sketch_add(QuantileSketch *sketch, double value);
+void sketch_merge(QuantileSketch *into, const QuantileSketch *from);
+double sketch_quantile(const QuantileSketch *sketch, double q);
+
+#endif // SKETCH_H
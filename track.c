@@ -0,0 +1,414 @@
+/*
+ * track.c - Shuffle tracking of slugs from one shoe into the next.
+ */
+#include <errno.h>
+#include <stdlib.h>
+#include "pool.h"
+#include "track.h"
+
+/*
+ * struct track_job - A tracking simulation run on a thread pool.
+ * @config: Configuration of the run.
+ * @model: Tracker's model of the procedure, see calibrate().
+ * @num_zones: Zones in a shoe.
+ * @total: Merged results of finished threads.
+ */
+struct track_job {
+	const TrackConfig *config;
+	const double *model;
+	size_t num_zones;
+	TrackResult *total;
+};
+
+/*
+ * struct track_local - State of one thread of a tracking simulation.
+ * @shoe: Shoe every chain of the thread is dealt from.
+ * @result: Chains the thread has played.
+ */
+struct track_local {
+	Deck *shoe;
+	TrackResult result;
+};
+
+/*
+ * zone_size - Cards in a zone of a shoe.
+ * @config: Configuration giving the zone size.
+ * @cards: Cards in the shoe.
+ * @zone: Index of the zone.
+ *
+ * Return: @config->zone, or fewer for a short last zone.
+ */
+static size_t zone_size(const TrackConfig *config, size_t cards, size_t zone)
+{
+	size_t start = zone * config->zone;
+	return cards - start < config->zone ? cards - start : config->zone;
+}
+
+/*
+ * calibrate - Learn where a shuffle procedure sends each zone of a shoe.
+ * @config: Configuration of the run.
+ * @cards: Cards in the shoe.
+ * @num_zones: Zones in the shoe, at most TRACK_MAX_ZONES.
+ * @model: Where to store the model, @num_zones squared entries.
+ *
+ * The tracker knows the procedure but not its cuts and drops, so it learns
+ * from shuffles of its own: every card of zone j is labelled with the
+ * card whose deck_composition() index is j, the shoe is shuffled and each
+ * label is counted where it lands. Entry i * @num_zones + j of @model is the
+ * expected share of zone j's cards landing in zone i, so a zone's expected
+ * Hi-Lo sum after the shuffle is the model's row times the zones' sums
+ * before it, with no card looked at.
+ *
+ * Return: 0 on success, -1 on error with errno set.
+ */
+static int calibrate(const TrackConfig *config, size_t cards, size_t num_zones,
+		     double *model)
+{
+	char *labels = malloc(3 * cards);
+	uint64_t *landed = calloc(num_zones * num_zones, sizeof(*landed));
+	if (labels == NULL || landed == NULL) {
+		free(labels);
+		free(landed);
+		errno = ENOMEM;
+		return -1;
+	}
+	for (size_t i = 0; i < cards; i++) {
+		size_t label = i / config->zone;
+		labels[3 * i] = "A23456789TJQK"[label % 13];
+		labels[3 * i + 1] = "SDCH"[label / 13];
+		labels[3 * i + 2] = ' ';
+	}
+	int ret = 0;
+	for (size_t k = 0; ret == 0 && k < config->calibration; k++) {
+		Deck *shoe = deck_parse(labels, 3 * cards);
+		if (shoe == NULL) {
+			ret = -1;
+			break;
+		}
+		deck_seed(shoe, config->seed, TRACK_CALIBRATION_STREAM + k);
+		ret = deck_procedure(shoe, config->steps, config->num_steps);
+		for (size_t i = 0; ret == 0 && i < cards; i++) {
+			Rank rank;
+			Suit suit;
+			ret = deck_draw(shoe, &rank, &suit);
+			if (ret == 0)
+				landed[i / config->zone * num_zones +
+				       suit * 13 + rank - 1]++;
+		}
+		int saved = errno;
+		unload_deck(shoe);
+		errno = saved;
+	}
+	for (size_t i = 0; ret == 0 && i < num_zones; i++) {
+		for (size_t j = 0; j < num_zones; j++) {
+			double size = (double)zone_size(config, cards, j);
+			model[i * num_zones + j] =
+				(double)landed[i * num_zones + j] /
+				((double)config->calibration * size);
+		}
+	}
+	free(labels);
+	free(landed);
+	return ret;
+}
+
+/*
+ * observe - Deal a shoe to its cut and sum the Hi-Lo tags of each zone.
+ * @shoe: Shoe to deal from, restacked so its count starts at 0.
+ * @config: Configuration giving the zone size.
+ * @cut: Cards dealt before the shuffle.
+ * @seen: Where to store the Hi-Lo sum of the dealt cards of each zone.
+ * @running: Where to store the running count of every card dealt.
+ *
+ * The running count is read at each zone boundary, so a zone's sum costs
+ * one deck_count() rather than a scan of its own.
+ *
+ * Return: 0 on success, -1 on error with errno set.
+ */
+static int observe(Deck *shoe, const TrackConfig *config, size_t cut,
+		   int *seen, int *running)
+{
+	int previous = 0;
+	*running = 0;
+	for (size_t i = 0, zone = 0; i < cut; zone++) {
+		size_t end = i + config->zone < cut ? i + config->zone : cut;
+		for (; i < end; i++) {
+			Rank rank;
+			Suit suit;
+			if (deck_draw(shoe, &rank, &suit) < 0)
+				return -1;
+		}
+		if (deck_count(shoe, running, NULL) < 0)
+			return -1;
+		seen[zone] = *running - previous;
+		previous = *running;
+	}
+	return 0;
+}
+
+/*
+ * predicted_bin - Bin of the true count predicted for a zone.
+ * @config: Configuration giving the zone size.
+ * @predicted: Expected Hi-Lo sum of the zone.
+ *
+ * Return: Index into the bins of a TrackResult.
+ */
+static size_t predicted_bin(const TrackConfig *config, double predicted)
+{
+	return (size_t)count_bin(-predicted * STANDARD_DECK_SIZE /
+				 (double)config->zone);
+}
+
+/*
+ * play_chain - Follow one shoe through successive shuffles.
+ * @job: Job holding the configuration and the tracker's model.
+ * @chain: Index of the chain, selects the stream its shoe is seeded with.
+ * @shoe: Shoe generated with @job->config->packs packs, renewed before use.
+ * @result: Result to add the chain to.
+ *
+ * Each shoe is dealt to the cut, its dealt cards go to the discard tray and
+ * the tray goes back on top of the unplayed cards for the procedure. The
+ * tracker summarises every zone by its Hi-Lo sum, sharing the count of the
+ * unplayed cards out evenly as it never sees them, predicts each zone of
+ * the next shoe from the model and picks the richest in tens and aces. The
+ * predictions are scored as the next shoe is dealt.
+ *
+ * Return: 0 on success, -1 on error with errno set.
+ */
+static int play_chain(const struct track_job *job, size_t chain, Deck *shoe,
+		      TrackResult *result)
+{
+	const TrackConfig *config = job->config;
+	size_t num_zones = job->num_zones;
+	deck_renew(shoe);
+	deck_seed(shoe, config->seed, chain);
+	deck_shuffle(shoe);
+	size_t cards = deck_size(shoe);
+	size_t cut = (size_t)(config->penetration * (double)cards);
+	size_t dealt_zones = cut / config->zone;
+	int seen[TRACK_MAX_ZONES];
+	double segments[TRACK_MAX_ZONES];
+	double predicted[TRACK_MAX_ZONES];
+	for (size_t shuffle = 0;; shuffle++) {
+		for (size_t i = 0; i < num_zones; i++)
+			seen[i] = 0;
+		int running;
+		if (observe(shoe, config, cut, seen, &running) < 0)
+			return -1;
+		if (shuffle > 0) {
+			size_t best = 0;
+			for (size_t i = 0; i < dealt_zones; i++) {
+				int64_t sum = seen[i];
+				size_t bin = predicted_bin(config,
+							   predicted[i]);
+				result->zones[bin]++;
+				result->zone_sum[bin] += sum;
+				result->zone_sq[bin] += (uint64_t)(sum * sum);
+				if (predicted[i] < predicted[best])
+					best = i;
+			}
+			result->transitions++;
+			result->slug_cards += config->zone;
+			result->slug_sum += seen[best];
+		}
+		if (shuffle == config->shuffles)
+			return 0;
+
+		// The unplayed cards balance the count of the dealt ones
+		double unseen = cut < cards ? -(double)running /
+					      (double)(cards - cut) : 0.0;
+		for (size_t j = 0; j < num_zones; j++) {
+			size_t start = j * config->zone;
+			size_t size = zone_size(config, cards, j);
+			size_t dealt = cut <= start ? 0 :
+				       cut - start < size ? cut - start : size;
+			segments[j] = seen[j] + unseen * (double)(size - dealt);
+		}
+		deck_discard(shoe, NULL);
+		deck_restack(shoe);
+		if (deck_procedure(shoe, config->steps, config->num_steps) < 0)
+			return -1;
+		for (size_t i = 0; i < dealt_zones; i++) {
+			const double *row = job->model + i * num_zones;
+			double sum = 0.0;
+			for (size_t j = 0; j < num_zones; j++)
+				sum += row[j] * segments[j];
+			predicted[i] = sum;
+		}
+	}
+}
+
+/*
+ * track_start - Set up a thread of a tracking simulation.
+ * @arg: Pointer to the struct track_job.
+ *
+ * Return: Pointer to the thread's struct track_local, or NULL on error with
+ * errno set.
+ */
+static void *track_start(void *arg)
+{
+	const struct track_job *job = arg;
+	struct track_local *local = malloc(sizeof(*local));
+	if (local == NULL) {
+		errno = ENOMEM;
+		return NULL;
+	}
+	// Every chain reseeds the shoe, so any seed will do but not rand()'s
+	local->shoe = deck_gen_seeded(job->config->packs, job->config->seed, 0);
+	if (local->shoe == NULL) {
+		free(local);
+		return NULL;
+	}
+	track_init(&local->result);
+	return local;
+}
+
+/*
+ * track_item - Play one chain on a thread.
+ * @arg: Pointer to the struct track_job.
+ * @local: Pointer to the thread's struct track_local.
+ * @chain: Index of the chain.
+ *
+ * Return: 0 on success, -1 on error with errno set.
+ */
+static int track_item(void *arg, void *local, size_t chain)
+{
+	const struct track_job *job = arg;
+	struct track_local *thread = local;
+	return play_chain(job, chain, thread->shoe, &thread->result);
+}
+
+/*
+ * track_gather - Merge a thread's chains into the run's result.
+ * @arg: Pointer to the struct track_job.
+ * @local: Pointer to the thread's struct track_local.
+ */
+static void track_gather(void *arg, void *local)
+{
+	const struct track_job *job = arg;
+	const struct track_local *thread = local;
+	track_merge(job->total, &thread->result);
+}
+
+/*
+ * track_finish - Free a thread of a tracking simulation.
+ * @arg: Pointer to the struct track_job.
+ * @local: Pointer to the thread's struct track_local.
+ */
+static void track_finish(void *arg, void *local)
+{
+	(void)arg;
+	struct track_local *thread = local;
+	unload_deck(thread->shoe);
+	free(thread);
+}
+
+/*
+ * track_init - Empty a tracking result.
+ * @result: Result to empty.
+ */
+void track_init(TrackResult *result)
+{
+	result->transitions = 0;
+	result->slug_cards = 0;
+	result->slug_sum = 0;
+	for (size_t i = 0; i < COUNT_BINS; i++) {
+		result->zones[i] = 0;
+		result->zone_sum[i] = 0;
+		result->zone_sq[i] = 0;
+	}
+}
+
+/*
+ * track_merge - Add one tracking result to another.
+ * @into: Result to add to.
+ * @from: Result to add.
+ */
+void track_merge(TrackResult *into, const TrackResult *from)
+{
+	into->transitions += from->transitions;
+	into->slug_cards += from->slug_cards;
+	into->slug_sum += from->slug_sum;
+	for (size_t i = 0; i < COUNT_BINS; i++) {
+		into->zones[i] += from->zones[i];
+		into->zone_sum[i] += from->zone_sum[i];
+		into->zone_sq[i] += from->zone_sq[i];
+	}
+}
+
+/*
+ * track_gain - True count of the slugs a tracker picks.
+ * @result: Result of a tracking run.
+ *
+ * Each true count is worth roughly half a percent of edge on the rounds
+ * dealt from the slug, compared with a count of 0 for an untracked zone.
+ *
+ * Return: Hi-Lo true count of the picked slugs' cards, positive when they
+ * are rich in tens and aces, or 0 if none were scored.
+ */
+double track_gain(const TrackResult *result)
+{
+	if (result == NULL || result->slug_cards == 0)
+		return 0.0;
+	return -(double)result->slug_sum /
+	       ((double)result->slug_cards / STANDARD_DECK_SIZE);
+}
+
+/*
+ * track_run - Simulate a shuffle tracker over many shoe transitions.
+ * @config: Configuration of the run.
+ * @result: Where to store the result, emptied first.
+ *
+ * The tracker's model is learned first on the calling thread, then chains
+ * are played as in play_chain(). A transition costs the deal to the cut, the
+ * procedure and a pass over the zone summaries, a few microseconds for a
+ * six pack shoe. Each chain deals from its own seeded shoe and every tally
+ * merges exactly, so the result depends only on the configuration and never
+ * on thread count or scheduling.
+ *
+ * Return: 0 on success, -1 on error with errno set.
+ */
+int track_run(const TrackConfig *config, TrackResult *result)
+{
+	if (config == NULL || result == NULL || config->packs < 1 ||
+	    !(config->penetration > 0.0 && config->penetration <= 1.0) ||
+	    config->zone == 0 || config->calibration == 0) {
+		errno = EINVAL;
+		return -1;
+	}
+	size_t cards = STANDARD_DECK_SIZE * (size_t)config->packs;
+	size_t num_zones = (cards + config->zone - 1) / config->zone;
+	size_t cut = (size_t)(config->penetration * (double)cards);
+	if (num_zones > TRACK_MAX_ZONES || cut < config->zone) {
+		errno = EINVAL;
+		return -1;
+	}
+	double *model = malloc(num_zones * num_zones * sizeof(*model));
+	if (model == NULL) {
+		errno = ENOMEM;
+		return -1;
+	}
+	if (calibrate(config, cards, num_zones, model) < 0) {
+		int saved = errno;
+		free(model);
+		errno = saved;
+		return -1;
+	}
+	track_init(result);
+	struct track_job job = { .config = config, .model = model,
+				 .num_zones = num_zones, .total = result };
+	PoolTask task = {
+		.items = config->chains,
+		.threads = config->threads,
+		.arg = &job,
+		.start = track_start,
+		.item = track_item,
+		.merge = track_gather,
+		.finish = track_finish,
+	};
+	int ret = pool_run(&task);
+	int saved = errno;
+	free(model);
+	errno = saved;
+	return ret;
+}
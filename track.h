@@ -0,0 +1,66 @@
+#ifndef TRACK_H
+#define TRACK_H
+
+#include <stddef.h> // provides size_t
+#include <stdint.h> // provides uint64_t
+#include "cards.h"
+
+#define TRACK_MAX_ZONES 52 // Zones a calibration deck can label, a card each
+#define TRACK_CALIBRATION_STREAM (UINT64_C(1) << 62) // First calibration stream
+
+/*
+ * struct track_config - Parameters of a shuffle tracking simulation.
+ * @packs: Number of packs in the shoe.
+ * @penetration: Fraction of the shoe dealt before it is shuffled.
+ * @steps: Shuffle procedure between shoes, see deck_procedure().
+ * @num_steps: Number of entries in @steps.
+ * @zone: Cards in each segment the tracker follows, the last may be short.
+ * @seed: Seed of the run, chain n deals from stream n of this seed.
+ * @chains: Number of shoes followed through successive shuffles.
+ * @shuffles: Shuffles each chain goes through.
+ * @calibration: Shuffles of a labelled shoe the tracker learns the
+ *               procedure from, on streams from TRACK_CALIBRATION_STREAM.
+ * @threads: Number of threads, 0 or 1 to run on the calling thread.
+ */
+typedef struct track_config {
+	int packs;
+	double penetration;
+	const ShuffleStep *steps;
+	size_t num_steps;
+	size_t zone;
+	uint64_t seed;
+	size_t chains;
+	size_t shuffles;
+	size_t calibration;
+	int threads;
+} TrackConfig;
+
+/*
+ * struct track_result - How well a tracker follows slugs through shuffles.
+ * @transitions: Shuffles whose next shoe was dealt and scored.
+ * @slug_cards: Cards in the zones the tracker picked as richest.
+ * @slug_sum: Hi-Lo sum of those cards once dealt.
+ * @zones: Dealt zones by the true count the tracker predicted, bin i holding
+ *         true count COUNT_MIN_TC + i, see count_bin().
+ * @zone_sum: Hi-Lo sum of the zones in each bin once dealt.
+ * @zone_sq: Sum of the squared Hi-Lo sums of the zones in each bin.
+ *
+ * Hi-Lo sums are negative for zones rich in tens and aces. Every tally is an
+ * integer, so merging results is exact and order free.
+ */
+typedef struct track_result {
+	uint64_t transitions;
+	uint64_t slug_cards;
+	int64_t slug_sum;
+	uint64_t zones[COUNT_BINS];
+	int64_t zone_sum[COUNT_BINS];
+	uint64_t zone_sq[COUNT_BINS];
+} TrackResult;
+
+/* Function prototypes. */
+void track_init(TrackResult *result);
+void track_merge(TrackResult *into, const TrackResult *from);
+double track_gain(const TrackResult *result);
+int track_run(const TrackConfig *config, TrackResult *result);
+
+#endif // TRACK_H